@@ -5,19 +5,70 @@ int main(int argc, char *argv[])
 {
     if (argc < 2 || (strcmp(argv[1], "--server") != 0 && strcmp(argv[1], "--client") != 0))
     {
-        fprintf(stderr, "Usage: %s --server|--client <CLIENT_ID>\n", argv[0]);
+        fprintf(stderr, "Usage: %s --server|--client <CLIENT_ID> [--transport fifo|socket|shm] [--workers <N>] [--request-workers <N>] [--round-timeout <S>] [--lobby-timeout <S>]\n", argv[0]);
         return 1;
     }
 
+    // The options after the mode and the client ID
+    int first_option = strcmp(argv[1], "--server") == 0 ? 2 : 3;
+    for (int i = first_option; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc)
+        {
+            transport = findTransport(argv[++i]);
+            if (transport == NULL)
+            {
+                fprintf(stderr, "Unknown transport: %s. Must be fifo, socket or shm.\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+        {
+            // Number of threads running the games, 0 runs them on the server thread
+            num_game_workers = atoi(argv[++i]);
+            if (num_game_workers < 0 || num_game_workers > MAX_THREADS)
+            {
+                fprintf(stderr, "Invalid number of workers: %s. Must be between 0 and %d.\n", argv[i], MAX_THREADS);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--request-workers") == 0 && i + 1 < argc)
+        {
+            // Number of threads running the requests, 0 runs them on the server loop
+            num_request_workers = atoi(argv[++i]);
+            if (num_request_workers < 0 || num_request_workers > MAX_THREADS)
+            {
+                fprintf(stderr, "Invalid number of request workers: %s. Must be between 0 and %d.\n", argv[i], MAX_THREADS);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--round-timeout") == 0 || strcmp(argv[i], "--lobby-timeout") == 0) && i + 1 < argc)
+        {
+            // Seconds a round or a waiting room waits for the players, 0 waits forever
+            int *timeout = strcmp(argv[i], "--round-timeout") == 0 ? &round_timeout : &lobby_timeout;
+            *timeout = atoi(argv[++i]);
+            if (*timeout < 0 || *timeout > MAX_TIMEOUT)
+            {
+                fprintf(stderr, "Invalid timeout: %s. Must be between 0 and %d seconds.\n", argv[i], MAX_TIMEOUT);
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
     if (strcmp(argv[1], "--server") == 0)
     {
         server();
     }
     else
     {
-        if (argc != 3)
+        if (argc < 3)
         {
-            fprintf(stderr, "Usage: %s --client <CLIENT_ID>\n", argv[0]);
+            fprintf(stderr, "Usage: %s --client <CLIENT_ID> [--transport fifo|socket|shm]\n", argv[0]);
             return 1;
         }
         if (!is_valid_id(argv[2]))
@@ -1,20 +1,65 @@
 #include "gameLogic.h"
 
-// Global variable to store every information about games.
-Game games[MAX_GAMES];
-int game_num = 1;
+// Global variable to store every information about games. Slot 0 is not used, so 0 is never a game ID.
+GameTable game_table = {.lock = PTHREAD_RWLOCK_INITIALIZER, .num_slots = 1};
 
-// Global variable to store every information about players.
-Player players[MAX_PLAYERS];
+// Global variable to store every information about players. The array grows when it is full, the index of a player
+// in it is the player ID. Protected by players_lock.
+Player *players = NULL;
 int num_players = 0;
+int num_registered = 0; // Players on the leaderboard, the others only joined a game without registering
+int players_capacity = 0;
+PlayerIndex player_index;
+// The registered players ordered like the leaderboard, the node of a player is at its ID
+RankNode *rank_nodes = NULL;
+int rank_root = -1;
 
-// Store all the thread IDs
+// Store all the thread IDs of the game workers
 pthread_t thread_ids[MAX_THREADS];
 int num_threads = 0;
 
-// Mutex and condition variable to synchronize threads
-pthread_mutex_t lock;
-pthread_cond_t cond;
+// Number of game workers the server starts, -1 for one per core
+int num_game_workers = -1;
+
+// Open response channels of the connected clients
+Connection connections[MAX_CONNECTIONS];
+
+// The event loop of the server, it watches the request FIFO and the response channels
+EventLoop server_loop = {.running = false};
+
+// The clients following each game
+GameSubscribers subscribers[MAX_GAMES];
+
+// Games that changed since the updates were pushed the last time. Any thread can add to it.
+pthread_mutex_t changed_lock = PTHREAD_MUTEX_INITIALIZER;
+bool game_changed[MAX_GAMES];
+int changed_games[MAX_GAMES];
+int num_changed_games = 0;
+
+// Pipe the other threads write to so the server loop wakes up and pushes the updates
+int wake_fds[2] = {-1, -1};
+
+// Lock of the players array. Games lock their own slot (Game.lock).
+// Lock order: a game lock can be held while taking players_lock, but never the other way around.
+pthread_rwlock_t players_lock;
+
+// The workers that run the games and their run queues
+WorkerPool worker_pool;
+
+// The workers that run the requests of the clients
+RequestStage request_stage;
+// Number of request workers the server starts, 0 runs the requests on the server loop
+int num_request_workers = 0;
+
+// Seconds the players have for a round and a waiting room has to fill up, 0 waits forever
+int round_timeout = 0;
+int lobby_timeout = 0;
+
+// The deadlines of the games
+TimerWheel timer_wheel = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// The games of the players and the open waiting rooms
+MembershipIndex membership = {.lock = PTHREAD_MUTEX_INITIALIZER};
 
 // --------------------------------------------------------
 // ---------------------- SERVER --------------------------
@@ -36,640 +81,4621 @@ void handle_server_sigterm(int sig)
     exit(1);
 }
 
-// Initialize mutex and condition variable
+// Initialize the lock of the players. The locks of the games are initialized when their slots are allocated.
 void setupForThreads(void)
 {
-    pthread_mutex_init(&lock, NULL);
-    pthread_cond_init(&cond, NULL);
+    pthread_rwlock_init(&players_lock, NULL);
 }
 
 // This is called as cleanup function when the program exits
 void endThreads(void)
 {
-    pthread_mutex_destroy(&lock);
-    pthread_cond_destroy(&cond);
+    pthread_rwlock_destroy(&players_lock);
+    for (int i = 1; i < game_table.num_slots; i++)
+    {
+        pthread_mutex_destroy(&gameAtSlot(i)->lock);
+    }
+}
+
+// Give the points of a finished round to the players.
+// A player gets a point for every other player with the move that the player's move beats, so it only needs the number of
+// players per move: the moves are counted once and every player looks up the count, it is linear in the number of players.
+void scoreRound(Game *game, int round)
+{
+    // The move beaten by each move: rock beats scissors, paper beats rock, scissors beat paper
+    const MoveCode beats[4] = {MOVE_NONE, MOVE_SCISSORS, MOVE_ROCK, MOVE_PAPER};
+    int count[4] = {0, 0, 0, 0};
+    for (int i = 0; i < game->words_per_round; i++)
+    {
+        countRoundMoves(atomic_load(&game->round_moves[round * game->words_per_round + i]), count);
+    }
+    for (int i = 0; i < game->num_players; i++)
+    {
+        game->playerScores[i] += count[beats[gameMove(game, round, i)]];
+    }
+}
+
+// Add the number of players per move in a round word to count. The lanes equal to a move are found with a few
+// bit operations and counted with a popcount, no player is looked at one by one.
+void countRoundMoves(uint32_t moves, int count[4])
+{
+    // 01 in the lane of every player
+    const uint32_t low_bits = 0x5555u;
+    for (int move = MOVE_ROCK; move <= MOVE_SCISSORS; move++)
+    {
+        // A lane is 00 after the xor if it holds the move
+        uint32_t difference = moves ^ (low_bits * (uint32_t)move);
+        count[move] += __builtin_popcount(~(difference | (difference >> 1)) & low_bits);
+    }
 }
 
-// This is the function that runs on a separate thread to handle a game
+// Move the game one step forward if it can. Returns true if the game changed.
 // All the server side game logic is implemented here (waiting for players, all rounds, point calculation, etc.)
-void *startGameServer(void *arg)
+// The lock of the game must be held.
+bool advanceGame(Game *game)
 {
-    int game_id = *(int *)arg;
-    free(arg);
-    arg = NULL;
-    // This part is for waiting for players. It waits until a player joins, it gets a signal and checks if the game if full.
-    bool condition = false;
-    do
+    switch (game->phase)
     {
-        pthread_mutex_lock(&lock);
-        condition = (games[game_id].num_joined_players == games[game_id].num_players);
-        if (!condition)
+    case GAME_WAITING:
+        // When the game is full it changes the state of the game to started
+        if (game->num_joined_players < game->num_players)
         {
-            pthread_cond_wait(&cond, &lock);
+            return false;
         }
-        pthread_mutex_unlock(&lock);
-    } while (!condition);
-    // when the game is full it changes the state of the game to started
-    pthread_mutex_lock(&lock);
-    games[game_id].started = true;
-    pthread_mutex_unlock(&lock);
-
-    // The first while loop is for the rounds.
-    bool condition1 = false;
-    bool condition2 = false;
-    do
+        game->phase = GAME_PLAYING;
+        game->started = true;
+        touchGame(game, &game->state_version);
+        setGameDeadline(game);
+        return true;
+    case GAME_PLAYING:
     {
-        pthread_mutex_lock(&lock);
-        int current_round = games[game_id].current_round - 1;
-        int decisionsCount = 0;
-        pthread_mutex_unlock(&lock);
-        // This is the loop for one game. It waits until all players make a decision. When a player makes a decision it sends a signal and checks if all players made a decision.
-        do
+        // A round is finished when all players made a decision
+        int current_round = game->current_round - 1;
+        if (atomic_load(&game->round_moved[current_round]) < game->num_players)
         {
-            pthread_mutex_lock(&lock);
-            decisionsCount = 0;
-            for (int i = 0; i < games[game_id].num_players; i++)
-            {
-                if (games[game_id].roundData[current_round][i] != 'n')
-                {
-                    decisionsCount++;
-                }
-            }
-            condition1 = decisionsCount < games[game_id].num_players;
-            if (condition1)
-            {
-                // Wait for signal from the function that handles new moves.
-                pthread_cond_wait(&cond, &lock);
-            }
-            pthread_mutex_unlock(&lock);
-        } while (condition1);
+            return false;
+        }
         // When a round is finished it calculates the points for each player.
-        pthread_mutex_lock(&lock);
-        for (int i = 0; i < games[game_id].num_players; i++)
+        scoreRound(game, current_round);
+        touchGame(game, &game->scores_version);
+        // The moves are sent with every delta while the round is played, after it only if they changed since
+        touchGame(game, &game->round_versions[current_round]);
+        // Go to the next round
+        game->current_round++;
+        touchGame(game, &game->state_version);
+        if (game->current_round > game->num_rounds)
         {
-            for (int j = 0; j < games[game_id].num_players; j++)
-            {
-                if (i != j)
-                {
-                    if (games[game_id].roundData[current_round][i] == 'p')
-                    {
-                        if (games[game_id].roundData[current_round][j] == 'r')
-                        {
-                            games[game_id].playerScores[i]++;
-                        }
-                    }
-                    if (games[game_id].roundData[current_round][i] == 'r')
-                    {
-                        if (games[game_id].roundData[current_round][j] == 's')
-                        {
-                            games[game_id].playerScores[i]++;
-                        }
-                    }
-                    if (games[game_id].roundData[current_round][i] == 's')
-                    {
-                        if (games[game_id].roundData[current_round][j] == 'p')
-                        {
-                            games[game_id].playerScores[i]++;
-                        }
-                    }
-                }
-            }
+            finishGame(game);
         }
-        // Go to the next round
-        games[game_id].current_round++;
-
-        // check if game is finished
-        condition2 = games[game_id].current_round > games[game_id].num_rounds;
+        // The next round has its own deadline, a finished game has none
+        setGameDeadline(game);
+        return true;
+    }
+    case GAME_FINISHED:
+    default:
+        return false;
+    }
+}
 
-        pthread_mutex_unlock(&lock);
-    } while (!condition2);
-    // when game ends
-    pthread_mutex_lock(&lock);
-    games[game_id].active = false;
+// When the game ends the points of the players are added to the leaderboard. The lock of the game must be held,
+// players_lock is taken after it.
+void finishGame(Game *game)
+{
+    game->phase = GAME_FINISHED;
+    game->active = false;
+    closeGameMembership(game);
     // add points to the players sum of points
     // add 1 to the players sum of matches
-    for (int i = 0; i < games[game_id].num_players; i++)
+    pthread_rwlock_wrlock(&players_lock);
+    for (int i = 0; i < game->num_players; i++)
     {
-        for (int j = 0; j < num_players; j++)
+        // Only the registered players are on the leaderboard
+        Player *player = &players[game->player_ids[i]];
+        if (player->registered)
         {
-            if (strcmp(games[game_id].playerNames[i], players[j].name) == 0)
-            {
-                players[j].score += games[game_id].playerScores[i];
-                players[j].matches++;
-                break;
-            }
+            addPlayerPoints(game->player_ids[i], game->playerScores[i]);
+            player->matches++;
         }
     }
-    pthread_mutex_unlock(&lock);
-    return NULL;
+    pthread_rwlock_unlock(&players_lock);
 }
 
-// This function is called when the server receives a command to create a new game
-// It initializes the game struct and starts a new thread to handle the game
-void createNewGameServer(int player_num, int num_rounds)
+// Run the state machine of a game until it has to wait for the players again
+void stepGame(int game_id)
 {
-    pthread_mutex_lock(&lock);
-    games[game_num].id = game_num;
-    games[game_num].num_players = player_num;
-    games[game_num].num_rounds = num_rounds;
-    games[game_num].current_round = 1;
-    games[game_num].started = false;
-    games[game_num].active = true;
-    games[game_num].num_joined_players = 0;
-    games[game_num].num_current_round = 0;
-    for (int i = 0; i < 5; i++)
+    Game *game = lockGame(game_id);
+    if (game == NULL)
+    {
+        return;
+    }
+    bool changed = false;
+    while (advanceGame(game))
+    {
+        changed = true;
+    }
+    bool finished = game->phase == GAME_FINISHED;
+    pthread_mutex_unlock(&game->lock);
+    // The players following the game see the result right away
+    if (changed)
+    {
+        notifyGameChanged(game_id);
+    }
+    // The slot of a finished game is reused when nobody follows the game anymore
+    if (finished)
     {
-        games[game_num].playerNames[i] = NULL;
-        // If a player made a decision it will be put at the correct index in the roundData string. If not, it will be 'n'.
-        games[game_num].roundData[i] = (char *)"nnnnn";
-        games[game_num].playerScores[i] = 0;
+        retireGame(game_id);
     }
-    pthread_mutex_unlock(&lock);
+}
 
-    int *game_id_ptr = malloc(sizeof(int));
-    if (game_id_ptr == NULL)
+// This function is called when the server receives a command to create a new game
+// It initializes the game struct. The game is run by the workers when its players join and move.
+void createNewGameServer(int player_num, int num_rounds)
+{
+    pthread_rwlock_wrlock(&game_table.lock);
+    int slot = takeGameSlot();
+    if (slot == 0)
     {
-        fprintf(stderr, "Error allocating memory\n");
+        pthread_rwlock_unlock(&game_table.lock);
+        fprintf(stderr, "Error: Too many games\n");
         return;
     }
-    *game_id_ptr = game_num;
-    // Start game on new thread
-    pthread_t thread_id;
-    if (pthread_create(&thread_id, NULL, startGameServer, game_id_ptr))
+    Game *game = gameAtSlot(slot);
+    pthread_mutex_lock(&game->lock);
+    if (!allocateGameRecord(game, player_num, num_rounds))
     {
-        fprintf(stderr, "Error creating thread\n");
-        // Free the allocated memory if thread creation fails
-        free(game_id_ptr);
-        game_id_ptr = NULL;
+        game_table.free_slots[game_table.num_free++] = slot;
+        pthread_mutex_unlock(&game->lock);
+        pthread_rwlock_unlock(&game_table.lock);
+        fprintf(stderr, "Memory allocation failed\n");
         return;
     }
-    // Store the thread ID
-    thread_ids[num_threads] = thread_id;
-    num_threads++;
-
-    // Detach the thread since we won't be joining it, it runs on its own until the game ends and reads from the global variables
-    pthread_detach(thread_id);
+    // A reused slot has a new generation, so the ID of the game that was there before does not find this one
+    game->id = (game->generation << GAME_SLOT_BITS) | slot;
+    game->current_round = 1;
+    game->phase = GAME_WAITING;
+    game->started = false;
+    game->num_joined_players = 0;
+    game->num_current_round = 0;
+    // A new game starts at version 1, every part of it is new
+    game->version = 1;
+    game->state_version = 1;
+    game->players_version = 1;
+    game->scores_version = 1;
+    for (int i = 0; i < num_rounds; i++)
+    {
+        game->round_versions[i] = 1;
+    }
+    setGameDeadline(game);
+    // The lists only show the game when everything is set
+    game->active = true;
+    game->live_index = game_table.num_live;
+    game_table.live[game_table.num_live++] = slot;
+    openRoom(game);
+    pthread_mutex_unlock(&game->lock);
+    pthread_rwlock_unlock(&game_table.lock);
+}
 
-    game_num++;
+// Find a slot for a new game: the slot of a retired game that nobody uses anymore or a new one.
+// The caller holds the table lock for writing. Returns 0 if all MAX_GAMES slots are used.
+int takeGameSlot(void)
+{
+    for (int i = game_table.num_free - 1; i >= 0; i--)
+    {
+        int slot = game_table.free_slots[i];
+        Game *game = gameAtSlot(slot);
+        // Without an ID nobody can take a new reference, the ones taken before are counted in refs
+        int old_id = atomic_exchange(&game->id, 0);
+        if (atomic_load(&game->refs) != 0)
+        {
+            atomic_store(&game->id, old_id);
+            continue;
+        }
+        game_table.free_slots[i] = game_table.free_slots[--game_table.num_free];
+        // The generation has to fit next to the slot in a positive int
+        game->generation = (game->generation + 1) & ((1 << (31 - GAME_SLOT_BITS)) - 1);
+        return slot;
+    }
+    if (game_table.num_slots == MAX_GAMES)
+    {
+        return 0;
+    }
+    int slot = game_table.num_slots;
+    if (atomic_load(&game_table.chunks[slot / GAME_CHUNK_SIZE]) == NULL)
+    {
+        Game *chunk = calloc(GAME_CHUNK_SIZE, sizeof(Game));
+        if (chunk == NULL)
+        {
+            return 0;
+        }
+        for (int i = 0; i < GAME_CHUNK_SIZE; i++)
+        {
+            pthread_mutex_init(&chunk[i].lock, NULL);
+            chunk[i].live_index = -1;
+        }
+        atomic_store(&game_table.chunks[slot / GAME_CHUNK_SIZE], chunk);
+    }
+    game_table.num_slots++;
+    return slot;
 }
 
-// This function is called when the server receives a command to get the game info
-// It returns a string containing all the information about the game
-// Format: GI;<num_players>;<player1>,<player2>,...;<current_round>,<num_rounds>;<player1_score>,<player2_score>,...;<round1_data>,<round2_data>,...
-char *getGameInfo(int game_id)
+// The game in a slot, NULL if the slot is not allocated
+Game *gameAtSlot(int slot)
 {
-    pthread_mutex_lock(&lock);
-    char *game_info = malloc(BUFSIZ * sizeof(char));
-    if (game_info == NULL)
+    if (slot <= 0 || slot >= MAX_GAMES)
     {
-        fprintf(stderr, "Error allocating memory\n");
         return NULL;
     }
-    // check if game is started
-    if (!games[game_id].started)
+    Game *chunk = atomic_load(&game_table.chunks[slot / GAME_CHUNK_SIZE]);
+    return chunk != NULL ? &chunk[slot % GAME_CHUNK_SIZE] : NULL;
+}
+
+// The slot part of a game ID
+int gameSlot(int game_id)
+{
+    return game_id & (MAX_GAMES - 1);
+}
+
+// The game with the ID or NULL if there is none. It does not lock the game, use lockGame() or acquireGame() to use it.
+Game *getGame(int game_id)
+{
+    Game *game = gameAtSlot(gameSlot(game_id));
+    return game != NULL && atomic_load(&game->id) == game_id ? game : NULL;
+}
+
+// Lock the game with the ID. Returns NULL if there is no such game, its slot can only be reused under the lock.
+Game *lockGame(int game_id)
+{
+    Game *game = gameAtSlot(gameSlot(game_id));
+    if (game == NULL)
     {
-        game_info[0] = '\0';
-        strcat(game_info, "notstarted");
-        return game_info;
+        return NULL;
     }
-    else
+    pthread_mutex_lock(&game->lock);
+    if (atomic_load(&game->id) != game_id)
     {
-        game_info[0] = '\0';
+        pthread_mutex_unlock(&game->lock);
+        return NULL;
     }
-    // Cat all the information about the game to the game_info string
-    sprintf(game_info, "GI;%d;", games[game_id].num_players);
+    return game;
+}
 
-    for (int i = 0; i < games[game_id].num_players; i++)
+// Take a reference to the game with the ID, its slot is not reused until releaseGame(). Returns NULL if there is no such game.
+Game *acquireGame(int game_id)
+{
+    Game *game = gameAtSlot(gameSlot(game_id));
+    if (game == NULL)
     {
-        strcat(game_info, games[game_id].playerNames[i]);
-        if (i < games[game_id].num_players - 1)
-        {
-            strcat(game_info, ",");
-        }
+        return NULL;
     }
-
-    strcat(game_info, ";");
-    sprintf(game_info, "%s%d,%d;", game_info, games[game_id].current_round, games[game_id].num_rounds);
-    for (int i = 0; i < games[game_id].num_players; i++)
+    atomic_fetch_add(&game->refs, 1);
+    // takeGameSlot() clears the ID before it looks at refs, so either it sees this reference or this sees the new ID
+    if (atomic_load(&game->id) != game_id)
     {
-        sprintf(game_info, "%s%d", game_info, games[game_id].playerScores[i]);
-        if (i < games[game_id].num_players - 1)
-        {
-            strcat(game_info, ",");
-        }
+        atomic_fetch_sub(&game->refs, 1);
+        return NULL;
     }
+    return game;
+}
+
+void releaseGame(Game *game)
+{
+    atomic_fetch_sub(&game->refs, 1);
+}
 
-    strcat(game_info, ";");
-    for (int i = 0; i < games[game_id].current_round; i++)
+// Take a finished game out of the live games. Its slot is reused by a new game once nobody holds a reference to it.
+void retireGame(int game_id)
+{
+    pthread_rwlock_wrlock(&game_table.lock);
+    // The ID is checked under the table lock, a late call for an old ID must not retire the game that reused its slot
+    Game *game = getGame(game_id);
+    if (game != NULL && game->live_index >= 0)
     {
-        strncat(game_info, games[game_id].roundData[i], games[game_id].num_players);
-        if (i < games[game_id].current_round - 1)
-        {
-            strcat(game_info, ",");
-        }
+        // The last live game takes its place
+        int last = game_table.live[--game_table.num_live];
+        game_table.live[game->live_index] = last;
+        gameAtSlot(last)->live_index = game->live_index;
+        game->live_index = -1;
+        game_table.free_slots[game_table.num_free++] = gameSlot(game_id);
     }
-    strcat(game_info, ";");
+    pthread_rwlock_unlock(&game_table.lock);
+}
 
-    pthread_mutex_unlock(&lock);
-    return game_info;
+// Remove every game, the allocated slots are kept. Used by the tests and the benchmarks to start from an empty server.
+void resetGames(void)
+{
+    pthread_rwlock_wrlock(&game_table.lock);
+    for (int i = 1; i < game_table.num_slots; i++)
+    {
+        Game *game = gameAtSlot(i);
+        freeGameRecord(game);
+        game->id = 0;
+        game->generation = 0;
+        game->refs = 0;
+        game->live_index = -1;
+        game->phase = GAME_WAITING;
+        game->started = false;
+        game->active = false;
+    }
+    game_table.num_slots = 1;
+    game_table.num_free = 0;
+    game_table.num_live = 0;
+    pthread_rwlock_unlock(&game_table.lock);
+    resetTimers();
+    resetMembership();
 }
 
-// This function is called when the server receives a command to register a new client
-bool registerClient(char *client_name)
+// Empty the arena and make room for size zeroed bytes. The old block is kept if it is big enough.
+// Returns false if there is no memory, then the arena is left as it was.
+bool arenaReset(GameArena *arena, size_t size)
 {
-    // check if name is already taken
-    pthread_mutex_lock(&lock);
-    for (int i = 0; i < num_players; i++)
+    if (size > arena->capacity)
     {
-        if (strcmp(players[i].name, client_name) == 0)
+        char *base = malloc(size);
+        if (base == NULL)
         {
-            pthread_mutex_unlock(&lock);
             return false;
         }
+        free(arena->base);
+        arena->base = base;
+        arena->capacity = size;
     }
-    // If not store the new player in the players array
-    strncpy(players[num_players].name, client_name, sizeof(players[num_players].name));
-    players[num_players].score = 0;
-    players[num_players].matches = 0;
-    num_players++;
-    pthread_mutex_unlock(&lock);
+    // Only the part the new game uses has to be cleared
+    memset(arena->base, 0, size);
+    arena->used = 0;
     return true;
 }
 
-// This function is called when the server receives a command to get the leaderboard
-char *getLeaderBoard(void)
+// Take size bytes from the arena, aligned for any of the game's parts. Returns NULL if the arena is full.
+void *arenaAlloc(GameArena *arena, size_t size)
 {
-    char *players_string = malloc(BUFSIZ * sizeof(char));
-    if (players_string == NULL)
+    size_t start = (arena->used + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    if (start + size > arena->capacity)
     {
-        fprintf(stderr, "Error allocating memory\n");
         return NULL;
     }
-    players_string[0] = '\0';
-    pthread_mutex_lock(&lock);
-    // Put the information about player points and matches in the players_string
-    for (int i = 0; i < num_players; i++)
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+// Give the block of the arena back to the system
+void arenaRelease(GameArena *arena)
+{
+    free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
+
+// Take the parts of a game that are sized by its number of players and rounds from its arena, all zeroed:
+// the player IDs, the round words, the moved counters, the round versions, the scores and the names.
+// Whatever the previous game of the slot had is dropped. Returns false if there is no memory.
+bool allocateGameRecord(Game *game, int num_players, int num_rounds)
+{
+    int words_per_round = (num_players + ROUND_WORD_PLAYERS - 1) / ROUND_WORD_PLAYERS;
+    size_t ids_size = (size_t)num_players * sizeof(int);
+    size_t moves_size = (size_t)num_rounds * (size_t)words_per_round * sizeof(uint32_t);
+    size_t moved_size = (size_t)num_rounds * sizeof(int);
+    size_t versions_size = (size_t)num_rounds * sizeof(uint32_t);
+    size_t scores_size = (size_t)num_players * sizeof(int);
+    size_t names_size = (size_t)num_players * (PLAYER_ID_WIDTH + 1);
+    // Every part can be padded by at most 7 bytes to keep the next one aligned
+    size_t size = ids_size + moves_size + moved_size + versions_size + scores_size + names_size + 6 * sizeof(uint64_t);
+    if (!arenaReset(&game->arena, size))
     {
-        char player_string[BUFSIZ];
-        snprintf(player_string, sizeof(player_string), "%s,%d,%d;", players[i].name, players[i].score, players[i].matches);
-        strcat(players_string, player_string);
+        return false;
     }
-    pthread_mutex_unlock(&lock);
-    return players_string;
+    game->num_players = num_players;
+    game->num_rounds = num_rounds;
+    game->words_per_round = words_per_round;
+    game->player_ids = arenaAlloc(&game->arena, ids_size);
+    game->round_moves = arenaAlloc(&game->arena, moves_size);
+    game->round_moved = arenaAlloc(&game->arena, moved_size);
+    game->round_versions = arenaAlloc(&game->arena, versions_size);
+    game->playerScores = arenaAlloc(&game->arena, scores_size);
+    game->playerNames = arenaAlloc(&game->arena, names_size);
+    return true;
 }
 
-// This function is called when the server receives a command to join a game
-bool joinGame(int game_id, char *client_name)
+// Free the arena of a game, used when the game is not going to be reused
+void freeGameRecord(Game *game)
 {
-    pthread_mutex_lock(&lock);
-    // check if game is started. If it already started no player can join
-    if (games[game_id].started)
+    arenaRelease(&game->arena);
+    game->player_ids = NULL;
+    game->round_moves = NULL;
+    game->round_moved = NULL;
+    game->round_versions = NULL;
+    game->playerScores = NULL;
+    game->playerNames = NULL;
+}
+
+// --------------------------------------------------------
+// -------------------- GAME WORKERS ----------------------
+// --------------------------------------------------------
+
+// The games are not run by a thread each. joinGame() and makeMove() put the game into the run queue of a worker and
+// a fixed number of workers take the games from their queue and run their state machine with stepGame().
+// Without workers (num_workers is 0) the game is stepped right away by the thread that changed it.
+// Every game belongs to one worker, so a change only wakes that worker and only if it is sleeping.
+
+// Put a game into the run queue of its worker. A game is in a queue at most once.
+void scheduleGame(int game_id)
+{
+    if (worker_pool.num_workers == 0)
     {
-        pthread_mutex_unlock(&lock);
-        return false;
+        stepGame(game_id);
+        return;
+    }
+    // If the game is already queued its next step sees this change too
+    int slot = gameSlot(game_id);
+    if (atomic_exchange(&worker_pool.scheduled[slot], true))
+    {
+        return;
+    }
+    GameWorker *worker = &worker_pool.workers[slot % worker_pool.num_workers];
+    pthread_mutex_lock(&worker->lock);
+    // The queue is linked through the slots, slot 0 is not used so 0 is the end
+    worker_pool.next_scheduled[slot] = 0;
+    if (worker->last != 0)
+    {
+        worker_pool.next_scheduled[worker->last] = slot;
     }
     else
     {
-        games[game_id].playerNames[games[game_id].num_joined_players] = strdup(client_name);
-        games[game_id].num_joined_players++;
-        // If a player joined send a signal to the thread that handles the game
-        // All threads get the signal but it only affects the thread that handles the game since it checks if the game is full
-        pthread_cond_broadcast(&cond);
-        pthread_mutex_unlock(&lock);
-        return true;
+        worker->first = slot;
+    }
+    worker->last = slot;
+    // A busy worker takes the game when it is done with the current one
+    if (worker->sleeping)
+    {
+        pthread_cond_signal(&worker->ready);
     }
+    pthread_mutex_unlock(&worker->lock);
 }
 
-// This function is called when the server receives a command to list the waiting games
-char *listWaitingGames(char *client_name)
+// The loop of one worker thread. It runs its queued games until the pool is stopped.
+void *gameWorker(void *arg)
 {
-    char *games_string = malloc(BUFSIZ * sizeof(char));
-    if (games_string == NULL)
-    {
-        fprintf(stderr, "Error allocating memory\n");
-        return NULL;
-    }
-    games_string[0] = '\0';
-    pthread_mutex_lock(&lock);
-    for (int i = 0; i < MAX_GAMES; i++)
+    GameWorker *worker = arg;
+    pthread_mutex_lock(&worker->lock);
+    while (true)
     {
-        if (games[i].active && !games[i].started)
+        while (worker->first == 0 && !worker->stopping)
         {
-            // check if client is not joined yet
-            // The client can only see the games that he is not joined yet and it is not started yet
-            bool joined = false;
-            // The already joined players are stored in the playerNames array
-            for (int j = 0; j < games[i].num_joined_players; j++)
-            {
-                if (strcmp(games[i].playerNames[j], client_name) == 0)
-                {
-                    joined = true;
-                    break;
-                }
-            }
-            // Cat all the games that the client can join to the games_string
-            if (!joined)
-            {
-                char buffer[3];
-                sprintf(buffer, "%d", i);
-                strcat(games_string, buffer);
-                strcat(games_string, ",");
-            }
+            worker->sleeping = true;
+            pthread_cond_wait(&worker->ready, &worker->lock);
+            worker->sleeping = false;
+            atomic_fetch_add(&worker_pool.wakeups, 1);
+        }
+        if (worker->first == 0)
+        {
+            // Stopping and nothing left to do
+            break;
+        }
+        int slot = worker->first;
+        worker->first = worker_pool.next_scheduled[slot];
+        if (worker->first == 0)
+        {
+            worker->last = 0;
         }
+        pthread_mutex_unlock(&worker->lock);
+        // Cleared before the step, so a change during the step queues the game again
+        atomic_store(&worker_pool.scheduled[slot], false);
+        // The game that is in the slot now
+        stepGame(atomic_load(&gameAtSlot(slot)->id));
+        pthread_mutex_lock(&worker->lock);
     }
-    pthread_mutex_unlock(&lock);
-    return games_string;
+    pthread_mutex_unlock(&worker->lock);
+    return NULL;
 }
 
-// This function is called when the server receives a command to list the games
-// It is the opposite of the listWaitingGames function. It only shows the games that the client is already joined
-char *listGames(char *client_name)
+// Start the workers. With 0 workers the games are stepped by the threads that change them.
+bool startWorkers(int count)
 {
-    char *games_string = malloc(BUFSIZ * sizeof(char));
-    if (games_string == NULL)
+    if (count > MAX_THREADS)
     {
-        fprintf(stderr, "Error allocating memory\n");
-        return NULL;
+        count = MAX_THREADS;
     }
-    games_string[0] = '\0';
-    pthread_mutex_lock(&lock);
+    atomic_store(&worker_pool.wakeups, 0);
     for (int i = 0; i < MAX_GAMES; i++)
     {
-        if (games[i].active)
+        atomic_store(&worker_pool.scheduled[i], false);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        GameWorker *worker = &worker_pool.workers[i];
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->ready, NULL);
+        worker->first = 0;
+        worker->last = 0;
+        worker->sleeping = false;
+        worker->stopping = false;
+        if (pthread_create(&thread_ids[num_threads], NULL, gameWorker, worker))
         {
-            // check if client is joined
-            bool joined = false;
-            // The already joined players are stored in the playerNames array
-            for (int j = 0; j < games[i].num_joined_players; j++)
-            {
-                if (strcmp(games[i].playerNames[j], client_name) == 0)
-                {
-                    joined = true;
-                    break;
-                }
-            }
-            // Cat all the games that the client is joined to the games_string
-            if (joined)
-            {
-                char buffer[3];
-                sprintf(buffer, "%d", i);
-                strcat(games_string, buffer);
-                strcat(games_string, ",");
-            }
+            fprintf(stderr, "Error creating thread\n");
+            stopWorkers();
+            return false;
         }
+        num_threads++;
+        worker_pool.num_workers++;
     }
-    pthread_mutex_unlock(&lock);
-    return games_string;
+    return true;
 }
 
-// This function is called when the server receives a command to make a decision
-void makeDecision(char *game_id_string, char *decision_string, char *client_name)
+// Stop the workers after they ran the games that are still queued
+void stopWorkers(void)
 {
-    if (game_id_string == NULL || decision_string == NULL)
+    for (int i = 0; i < worker_pool.num_workers; i++)
     {
-        printf("Error: Invalid command format\n");
+        GameWorker *worker = &worker_pool.workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->stopping = true;
+        pthread_cond_signal(&worker->ready);
+        pthread_mutex_unlock(&worker->lock);
     }
-    int game_id = atoi(game_id_string);
-    pthread_mutex_lock(&lock);
-    int current_round = games[game_id].current_round - 1;
-    int player_index = -1;
-    // Find the index of the player in the playerNames array
-    for (int i = 0; i < games[game_id].num_players; i++)
+    for (int i = 0; i < num_threads; i++)
     {
-        if (strcmp(games[game_id].playerNames[i], client_name) == 0)
-        {
-            player_index = i;
-            break;
-        }
+        pthread_join(thread_ids[i], NULL);
     }
-    // Modify the roundData string at the correct index
-    char *playerDecisionsCopy = strdup(games[game_id].roundData[current_round]);
-    if (playerDecisionsCopy == NULL)
+    for (int i = 0; i < worker_pool.num_workers; i++)
     {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
+        pthread_mutex_destroy(&worker_pool.workers[i].lock);
+        pthread_cond_destroy(&worker_pool.workers[i].ready);
     }
-    playerDecisionsCopy[player_index] = decision_string[0];
-    games[game_id].roundData[current_round] = playerDecisionsCopy;
-    // Send a signal to the thread that handles the game
-    pthread_cond_broadcast(&cond);
-    pthread_mutex_unlock(&lock);
+    num_threads = 0;
+    worker_pool.num_workers = 0;
 }
 
-// This function initializes the server
-void server(void)
+// The default number of workers is the number of cores
+int defaultWorkerCount(void)
 {
-    // Create all necessary data for the server to start
-    setupForThreads();
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
 
-    int pipe_fd;
-    char buf[BUFSIZ];
+// This function is called when the server receives a command to get the game info
+// It returns a string containing all the information about the game
+// Format: GI;<num_players>;<player1>,<player2>,...;<current_round>,<num_rounds>;<player1_score>,<player2_score>,...;<round1_data>,<round2_data>,...
+char *getGameInfo(int game_id)
+{
+    // Every part is appended once to the end of the string, so building it takes linear time
+    StringBuilder game_info = {NULL, 0, 0};
+    if (!builderAppend(&game_info, "", 0))
+    {
+        return NULL;
+    }
+    // check if game is started, a game that does not exist is not started either
+    Game *game = lockGame(game_id);
+    if (game == NULL || !game->started)
+    {
+        if (game != NULL)
+        {
+            pthread_mutex_unlock(&game->lock);
+        }
+        builderAppend(&game_info, "notstarted", strlen("notstarted"));
+        return game_info.data;
+    }
+    // Append all the information about the game to the game_info string
+    builderPrintf(&game_info, "GI;%d;", game->num_players);
+    for (int i = 0; i < game->num_players; i++)
+    {
+        builderPrintf(&game_info, i < game->num_players - 1 ? "%s," : "%s;", game->playerNames[i]);
+    }
+    builderPrintf(&game_info, "%d,%d;", game->current_round, game->num_rounds);
+    for (int i = 0; i < game->num_players; i++)
+    {
+        builderPrintf(&game_info, i < game->num_players - 1 ? "%d," : "%d;", game->playerScores[i]);
+    }
+    int num_rounds = playedRounds(game->current_round, game->num_rounds);
+    for (int i = 0; i < num_rounds; i++)
+    {
+        // A round is written as one character per player: 'r', 'p', 's' or 'n' if there is no decision yet
+        for (int j = 0; j < game->num_players; j++)
+        {
+            char decision = moveChar(gameMove(game, i, j));
+            builderAppend(&game_info, &decision, 1);
+        }
+        if (i < num_rounds - 1)
+        {
+            builderAppend(&game_info, ",", 1);
+        }
+    }
+    builderAppend(&game_info, ";", 1);
 
-    /* create the FIFO (named pipe) */
-    mkfifo(FIFO_FILE, 0666);
+    pthread_mutex_unlock(&game->lock);
+    return game_info.data;
+}
 
-    printf("Server ON.\n");
+// Mark a part of the game as changed. The caller holds the lock of the game.
+void touchGame(Game *game, uint32_t *part)
+{
+    // makeMove() increments the version without the lock
+    *part = atomic_fetch_add(&game->version, 1) + 1;
+}
 
-    signal(SIGTERM, handle_server_sigterm); // Register the SIGTERM signal handler
-    signal(SIGINT, handle_server_sigint);   // Register the SIGINT signal handler
+// The changes of a game since the version the client has, in the binary encoding (see encodeGameDelta()).
+// It is written into buffer (GAME_DELTA_MAX_SIZE bytes) and the version it brings the client to is put into version.
+// Returns the number of bytes written.
+size_t getGameDeltaBinary(int game_id, uint32_t since, uint8_t *buffer, uint32_t *version)
+{
+    Game *game = lockGame(game_id);
+    if (game == NULL)
+    {
+        // A game that does not exist is sent as an empty game that has not started
+        size_t length = putVarint(buffer, 0);
+        buffer[length++] = 0;
+        buffer[length++] = 0;
+        *version = 0;
+        return length;
+    }
+    size_t length = encodeGameDelta(game, since, buffer);
+    pthread_mutex_unlock(&game->lock);
+    // A move can increment the version while the delta is encoded, so it is read back from the delta
+    const uint8_t *cursor = buffer;
+    getVarint(&cursor, buffer + length, version);
+    return length;
+}
 
-    while (true)
+// The same as getGameInfo() in the binary encoding. It is written into buffer (GAME_INFO_MAX_SIZE bytes), nothing is allocated.
+// Returns the number of bytes written.
+size_t getGameInfoBinary(int game_id, uint8_t *buffer)
+{
+    Game *game = lockGame(game_id);
+    if (game == NULL)
     {
-        // Continuously read from the pipe
-        pipe_fd = open(FIFO_FILE, O_RDONLY);
-        if (read(pipe_fd, buf, BUFSIZ) > 0)
-        {
-            // Print the received message
-            printf("%s\n", buf);
-            // Split the message into client_id and command
-            char *saveptr1;
-            char *client_name = strtok_r(buf, ": ", &saveptr1);
-            char *command = strtok_r(NULL, ": ", &saveptr1);
-            // Check what action the client wants to do
-            if (strcmp(command, "C") == 0)
-            {
-                // This is for when a new client wants to register
-                bool registered = false;
-                // Check if the name is already taken
-                registered = registerClient(client_name);
-                char message[BUFSIZ];
-                message[0] = '\0';
-                // Send a message to the client if the registration was successful or not
-                if (registered)
-                {
-                    strcpy(message, "registered");
-                }
-                else
-                {
-                    strcpy(message, "notregistered");
-                }
+        // A game that does not exist has not started
+        buffer[0] = 0;
+        return 1;
+    }
+    size_t length = encodeGameInfo(game, buffer);
+    pthread_mutex_unlock(&game->lock);
+    return length;
+}
+
+// This function is called when the server receives a command to register a new client
+bool registerClient(char *client_name)
+{
+    uint64_t key = playerKey(client_name);
+    // check if name is already taken
+    pthread_rwlock_wrlock(&players_lock);
+    int id = key != 0 ? internPlayer(key, client_name) : -1;
+    if (id < 0 || players[id].registered)
+    {
+        pthread_rwlock_unlock(&players_lock);
+        return false;
+    }
+    players[id].registered = true;
+    num_registered++;
+    rankPlayer(id);
+    pthread_rwlock_unlock(&players_lock);
+    return true;
+}
+
+// The ID of the player with the name. A name that is not known yet gets the next ID, not registered.
+// Returns -1 if there is no memory. players_lock must be held for writing.
+int internPlayer(uint64_t key, const char *client_name)
+{
+    int id = lookupPlayer(key);
+    if (id >= 0)
+    {
+        return id;
+    }
+    if (!growPlayers())
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    // Store the new player in the players array and its ID in the index
+    id = num_players;
+    strncpy(players[id].name, client_name, sizeof(players[id].name) - 1);
+    players[id].name[sizeof(players[id].name) - 1] = '\0';
+    players[id].score = 0;
+    players[id].matches = 0;
+    players[id].registered = false;
+    uint32_t entry = playerHash(key) & (uint32_t)(player_index.size - 1);
+    while (player_index.keys[entry] != 0)
+    {
+        entry = (entry + 1) & (uint32_t)(player_index.size - 1);
+    }
+    player_index.keys[entry] = key;
+    player_index.ids[entry] = id;
+    num_players++;
+    return id;
+}
+
+// Make room for one more player: the players array doubles when it is full, and the index doubles when the new player
+// would make it more than half full, so the probes stay short. players_lock must be held for writing.
+bool growPlayers(void)
+{
+    if (num_players == players_capacity)
+    {
+        // The ranking has a node for every player
+        int capacity = players_capacity > 0 ? players_capacity * 2 : PLAYER_INDEX_MIN_SIZE / 2;
+        RankNode *grown_nodes = realloc(rank_nodes, sizeof(RankNode) * (size_t)capacity);
+        if (grown_nodes == NULL)
+        {
+            return false;
+        }
+        rank_nodes = grown_nodes;
+        Player *grown = realloc(players, sizeof(Player) * (size_t)capacity);
+        if (grown == NULL)
+        {
+            return false;
+        }
+        players = grown;
+        players_capacity = capacity;
+    }
+    if ((num_players + 1) * 2 <= player_index.size)
+    {
+        return true;
+    }
+    int size = player_index.size > 0 ? player_index.size * 2 : PLAYER_INDEX_MIN_SIZE;
+    uint64_t *keys = calloc((size_t)size, sizeof(uint64_t));
+    int *ids = malloc(sizeof(int) * (size_t)size);
+    if (keys == NULL || ids == NULL)
+    {
+        free(keys);
+        free(ids);
+        return false;
+    }
+    // Every player is put into the bigger index again
+    for (int i = 0; i < num_players; i++)
+    {
+        uint64_t key = playerKey(players[i].name);
+        uint32_t entry = playerHash(key) & (uint32_t)(size - 1);
+        while (keys[entry] != 0)
+        {
+            entry = (entry + 1) & (uint32_t)(size - 1);
+        }
+        keys[entry] = key;
+        ids[entry] = i;
+    }
+    free(player_index.keys);
+    free(player_index.ids);
+    player_index.keys = keys;
+    player_index.ids = ids;
+    player_index.size = size;
+    return true;
+}
+
+// The ID of the player with the key or -1 if nobody registered with that name. players_lock must be held.
+int lookupPlayer(uint64_t key)
+{
+    if (player_index.size == 0)
+    {
+        return -1;
+    }
+    uint32_t entry = playerHash(key) & (uint32_t)(player_index.size - 1);
+    // The index is never full, so an empty entry ends the probe
+    while (player_index.keys[entry] != 0)
+    {
+        if (player_index.keys[entry] == key)
+        {
+            return player_index.ids[entry];
+        }
+        entry = (entry + 1) & (uint32_t)(player_index.size - 1);
+    }
+    return -1;
+}
+
+// The ID of a player or -1 if the name is not known
+int playerId(const char *client_name)
+{
+    uint64_t key = playerKey(client_name);
+    pthread_rwlock_rdlock(&players_lock);
+    int id = lookupPlayer(key);
+    pthread_rwlock_unlock(&players_lock);
+    return id;
+}
+
+// Spread the bits of a key over the high bits with a multiplication (Fibonacci hashing), the index uses the high half
+uint32_t playerHash(uint64_t key)
+{
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// Remove every player, the memory is kept. Used by the tests and the benchmarks to start from an empty server.
+void resetPlayers(void)
+{
+    pthread_rwlock_wrlock(&players_lock);
+    num_players = 0;
+    num_registered = 0;
+    rank_root = -1;
+    if (player_index.size > 0)
+    {
+        memset(player_index.keys, 0, sizeof(uint64_t) * (size_t)player_index.size);
+    }
+    pthread_rwlock_unlock(&players_lock);
+}
+
+// This function is called when the server receives a command to get the leaderboard
+char *getLeaderBoard(void)
+{
+    // The string grows with the number of players, a message can be as long as needed
+    StringBuilder players_string = {NULL, 0, 0};
+    if (!builderAppend(&players_string, "", 0))
+    {
+        return NULL;
+    }
+    // Many clients can read the leaderboard at the same time
+    pthread_rwlock_rdlock(&players_lock);
+    // Put the information about player points and matches in the players_string
+    for (int i = 0; i < num_players; i++)
+    {
+        if (players[i].registered)
+        {
+            builderPrintf(&players_string, "%s,%d,%d;", players[i].name, players[i].score, players[i].matches);
+        }
+    }
+    pthread_rwlock_unlock(&players_lock);
+    return players_string.data;
+}
+
+// This function is called when the server receives a command to join a game
+bool joinGame(int game_id, char *client_name)
+{
+    // The game keeps the ID of the player, a name is looked up before the game is locked
+    uint64_t key = playerKey(client_name);
+    int player_id = playerId(client_name);
+    if (player_id < 0 && key != 0)
+    {
+        pthread_rwlock_wrlock(&players_lock);
+        player_id = internPlayer(key, client_name);
+        pthread_rwlock_unlock(&players_lock);
+    }
+    Game *game = player_id >= 0 ? lockGame(game_id) : NULL;
+    if (game == NULL)
+    {
+        return false;
+    }
+    // check if game is started. If it already started or it is full no player can join, and a player has one seat
+    if (game->phase != GAME_WAITING || game->num_joined_players >= game->num_players || isJoined(game, player_id) ||
+        !addMembership(player_id, game_id))
+    {
+        pthread_mutex_unlock(&game->lock);
+        return false;
+    }
+    else
+    {
+        strncpy(game->playerNames[game->num_joined_players], client_name, PLAYER_ID_WIDTH);
+        game->player_ids[game->num_joined_players] = player_id;
+        game->num_joined_players++;
+        // A full room is not listed anymore, even before a worker starts the game
+        if (game->num_joined_players == game->num_players)
+        {
+            closeRoom(game);
+        }
+        else
+        {
+            fillRoom(game);
+        }
+        touchGame(game, &game->players_version);
+        pthread_mutex_unlock(&game->lock);
+        notifyGameChanged(game_id);
+        // The game starts when the last player joined
+        scheduleGame(game_id);
+        return true;
+    }
+}
+
+// Returns true if the player is one of the joined players of the game
+bool isJoined(const Game *game, int player_id)
+{
+    return findPlayer(game, player_id) >= 0;
+}
+
+// The index of the player among the joined players of the game or -1 if the player did not join
+int findPlayer(const Game *game, int player_id)
+{
+    for (int i = 0; i < game->num_joined_players; i++)
+    {
+        if (game->player_ids[i] == player_id)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A player ID packed into a number, two IDs are equal if their keys are equal
+uint64_t playerKey(const char *client_name)
+{
+    uint64_t key = 0;
+    memcpy(&key, client_name, strnlen(client_name, sizeof(key)));
+    return key;
+}
+
+// Format a list of game IDs as "<id>,<id>,..."
+char *formatGameList(const int game_ids[], int count)
+{
+    StringBuilder games_string = {NULL, 0, 0};
+    if (!builderAppend(&games_string, "", 0))
+    {
+        return NULL;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        builderPrintf(&games_string, "%d,", game_ids[i]);
+    }
+    return games_string.data;
+}
+
+// This function is called when the server receives a command to list the waiting games
+char *listWaitingGames(char *client_name)
+{
+    int game_ids[MAX_GAMES];
+    int count = findWaitingGames(client_name, game_ids);
+    return formatGameList(game_ids, count);
+}
+
+// This function is called when the server receives a command to list the games
+// It is the opposite of the listWaitingGames function. It only shows the games that the client is already joined
+char *listGames(char *client_name)
+{
+    int game_ids[MAX_GAMES];
+    int count = findPlayerGames(client_name, game_ids);
+    return formatGameList(game_ids, count);
+}
+
+// This function is called when the server receives a command to make a decision
+void makeDecision(char *game_id_string, char *decision_string, char *client_name)
+{
+    if (game_id_string == NULL || decision_string == NULL)
+    {
+        printf("Error: Invalid command format\n");
+        return;
+    }
+    makeMove(atoi(game_id_string), decision_string[0], client_name);
+}
+
+// Store the decision of a player in the current round of the game. It does not take the lock of the game:
+// the players do not change once the game is played and the move is set in the round word with a compare and swap.
+void makeMove(int game_id, char decision, const char *client_name)
+{
+    // The reference keeps the slot from being reused while the move is stored
+    Game *game = acquireGame(game_id);
+    if (game == NULL)
+    {
+        printf("Error: %s cannot make a decision in game %d\n", client_name, game_id);
+        return;
+    }
+    MoveCode move = moveCode(decision);
+    // The phase is set after the players, so the players can be read when the game is played
+    int player_index = atomic_load(&game->phase) == GAME_PLAYING ? findPlayer(game, playerId(client_name)) : -1;
+    int current_round = atomic_load(&game->current_round) - 1;
+    // Only the players of a started game can make a decision, once per round
+    if (player_index < 0 || move == MOVE_NONE || current_round >= game->num_rounds ||
+        !submitMove(game, current_round, player_index, move))
+    {
+        releaseGame(game);
+        printf("Error: %s cannot make a decision in game %d\n", client_name, game_id);
+        return;
+    }
+    atomic_fetch_add(&game->version, 1);
+    // The round ends when the last player made a decision
+    bool round_finished = atomic_load(&game->round_moved[current_round]) == game->num_players;
+    releaseGame(game);
+    notifyGameChanged(game_id);
+    if (round_finished)
+    {
+        scheduleGame(game_id);
+    }
+}
+
+// Set the move of a player in a round if the player did not move yet. Returns false if the player already moved.
+// The move and the submitted bit are set together, so nobody sees one without the other.
+bool submitMove(Game *game, int round, int player, MoveCode move)
+{
+    _Atomic uint32_t *word = roundWord(game, round, player);
+    int lane = player % ROUND_WORD_PLAYERS;
+    uint32_t submitted = 1u << (ROUND_SUBMITTED_SHIFT + lane);
+    uint32_t moves = atomic_load(word);
+    do
+    {
+        if (moves & submitted)
+        {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(word, &moves, moves | submitted | ((uint32_t)move << (lane * 2))));
+    // The round is finished when every player is counted
+    atomic_fetch_add(&game->round_moved[round], 1);
+    return true;
+}
+
+// The round word that holds the move of a player
+_Atomic uint32_t *roundWord(const Game *game, int round, int player)
+{
+    return &game->round_moves[round * game->words_per_round + player / ROUND_WORD_PLAYERS];
+}
+
+// The move of a player in a round of the game
+MoveCode gameMove(const Game *game, int round, int player)
+{
+    return roundMove(atomic_load(roundWord(game, round, player)), player % ROUND_WORD_PLAYERS);
+}
+
+// The number of rounds that are played or being played. current_round is one past the last round when the game is over.
+int playedRounds(int current_round, int num_rounds)
+{
+    return current_round < num_rounds ? current_round : num_rounds;
+}
+
+// --------------------------------------------------------
+// --------------------- MEMBERSHIP -----------------------
+// --------------------------------------------------------
+
+// The games of every player and the open waiting rooms are kept up to date, so SG reads the games of one player and
+// SW reads the open rooms without the ones the player joined, instead of locking every game and comparing its players.
+
+// List a new waiting room. The lock of the game must be held.
+void openRoom(const Game *game)
+{
+    int slot = gameSlot(game->id);
+    pthread_mutex_lock(&membership.lock);
+    if (!(membership.open[slot / 64] & (1ull << (slot % 64))))
+    {
+        membership.open[slot / 64] |= 1ull << (slot % 64);
+        membership.open_words[slot / 4096] |= 1ull << (slot / 64 % 64);
+        membership.open_ids[slot] = game->id;
+        membership.num_open++;
+        membership.room_serials[slot] = ++membership.next_room_serial;
+        membership.room_players[slot] = game->num_players;
+        membership.room_rounds[slot] = game->num_rounds;
+        membership.room_joined[slot] = game->num_joined_players;
+        insertRoom(&membership.by_age, slot, roomKey(slot, LOBBY_BY_AGE));
+        insertRoom(&membership.by_fill, slot, roomKey(slot, LOBBY_BY_FILL));
+    }
+    pthread_mutex_unlock(&membership.lock);
+}
+
+// Stop listing a waiting room because it is full or closed. The lock of the game must be held.
+void closeRoom(const Game *game)
+{
+    int slot = gameSlot(game->id);
+    pthread_mutex_lock(&membership.lock);
+    if (membership.open[slot / 64] & (1ull << (slot % 64)))
+    {
+        membership.open[slot / 64] &= ~(1ull << (slot % 64));
+        if (membership.open[slot / 64] == 0)
+        {
+            membership.open_words[slot / 4096] &= ~(1ull << (slot / 64 % 64));
+        }
+        membership.num_open--;
+        removeRoom(&membership.by_age, slot);
+        removeRoom(&membership.by_fill, slot);
+    }
+    pthread_mutex_unlock(&membership.lock);
+}
+
+// Add a game to the games of a player. The lock of the game must be held. Returns false if there is no memory.
+bool addMembership(int player_id, int game_id)
+{
+    pthread_mutex_lock(&membership.lock);
+    if (player_id >= membership.players_capacity)
+    {
+        int capacity = membership.players_capacity > 0 ? membership.players_capacity : PLAYER_INDEX_MIN_SIZE / 2;
+        while (capacity <= player_id)
+        {
+            capacity *= 2;
+        }
+        PlayerGames *grown = realloc(membership.players, sizeof(PlayerGames) * (size_t)capacity);
+        if (grown == NULL)
+        {
+            pthread_mutex_unlock(&membership.lock);
+            return false;
+        }
+        memset(grown + membership.players_capacity, 0, sizeof(PlayerGames) * (size_t)(capacity - membership.players_capacity));
+        membership.players = grown;
+        membership.players_capacity = capacity;
+    }
+    PlayerGames *games = &membership.players[player_id];
+    if (games->count == games->capacity)
+    {
+        int capacity = games->capacity > 0 ? games->capacity * 2 : 4;
+        int *grown = realloc(games->game_ids, sizeof(int) * (size_t)capacity);
+        if (grown == NULL)
+        {
+            pthread_mutex_unlock(&membership.lock);
+            return false;
+        }
+        games->game_ids = grown;
+        games->capacity = capacity;
+    }
+    games->game_ids[games->count++] = game_id;
+    pthread_mutex_unlock(&membership.lock);
+    return true;
+}
+
+// Take a game out of the games of a player. membership.lock must be held.
+void removeMembership(int player_id, int game_id)
+{
+    PlayerGames *games = &membership.players[player_id];
+    for (int i = 0; i < games->count; i++)
+    {
+        if (games->game_ids[i] == game_id)
+        {
+            // The order does not matter, the last game takes its place
+            games->game_ids[i] = games->game_ids[--games->count];
+            return;
+        }
+    }
+}
+
+// A finished game is not listed anymore, neither as a room nor as a game of its players. The lock of the game must be held.
+void closeGameMembership(const Game *game)
+{
+    closeRoom(game);
+    pthread_mutex_lock(&membership.lock);
+    for (int i = 0; i < game->num_joined_players; i++)
+    {
+        removeMembership(game->player_ids[i], game->id);
+    }
+    pthread_mutex_unlock(&membership.lock);
+}
+
+// Forget every game and room, the memory is kept. Called by resetGames().
+void resetMembership(void)
+{
+    pthread_mutex_lock(&membership.lock);
+    memset(membership.open, 0, sizeof(membership.open));
+    memset(membership.open_words, 0, sizeof(membership.open_words));
+    membership.num_open = 0;
+    membership.by_age.root = 0;
+    membership.by_fill.root = 0;
+    membership.next_room_serial = 0;
+    for (int i = 0; i < membership.players_capacity; i++)
+    {
+        membership.players[i].count = 0;
+    }
+    pthread_mutex_unlock(&membership.lock);
+}
+
+// Put the IDs of the games the client can join into game_ids (MAX_GAMES long). Returns the number of games.
+// The client can only see the games that he is not joined yet and it is not started yet
+int findWaitingGames(const char *client_name, int game_ids[])
+{
+    int count = 0;
+    // The name is looked up once, the rooms are compared by slot
+    int player_id = playerId(client_name);
+    uint64_t joined[MAX_GAMES / 64];
+    pthread_mutex_lock(&membership.lock);
+    markJoinedRooms(player_id, joined);
+    // Only the words with an open room are read, and the rooms the player joined are masked out 64 at a time
+    for (int i = 0; i < MAX_GAMES / 64 / 64; i++)
+    {
+        for (uint64_t words = membership.open_words[i]; words != 0; words &= words - 1)
+        {
+            int word = i * 64 + __builtin_ctzll(words);
+            for (uint64_t rooms = membership.open[word] & ~joined[word]; rooms != 0; rooms &= rooms - 1)
+            {
+                game_ids[count++] = membership.open_ids[word * 64 + __builtin_ctzll(rooms)];
+            }
+        }
+    }
+    pthread_mutex_unlock(&membership.lock);
+    return count;
+}
+
+// Set the bits of the slots of the games a player is in, the other bits are cleared. membership.lock must be held.
+void markJoinedRooms(int player_id, uint64_t joined[MAX_GAMES / 64])
+{
+    memset(joined, 0, sizeof(uint64_t) * (MAX_GAMES / 64));
+    if (player_id >= 0 && player_id < membership.players_capacity)
+    {
+        const PlayerGames *games = &membership.players[player_id];
+        for (int i = 0; i < games->count; i++)
+        {
+            int slot = gameSlot(games->game_ids[i]);
+            joined[slot / 64] |= 1ull << (slot % 64);
+        }
+    }
+}
+
+// Put the IDs of the active games the client is joined to into game_ids (MAX_GAMES long). Returns the number of games.
+int findPlayerGames(const char *client_name, int game_ids[])
+{
+    int count = 0;
+    int player_id = playerId(client_name);
+    pthread_mutex_lock(&membership.lock);
+    if (player_id >= 0 && player_id < membership.players_capacity)
+    {
+        count = membership.players[player_id].count;
+        memcpy(game_ids, membership.players[player_id].game_ids, sizeof(int) * (size_t)count);
+    }
+    pthread_mutex_unlock(&membership.lock);
+    return count;
+}
+
+// --------------------------------------------------------
+// ----------------------- LOBBY --------------------------
+// --------------------------------------------------------
+
+// The open rooms are also kept in two treaps, one by age and one by fill level, under membership.lock. A page of the
+// lobby starts at the cursor in O(log n) and reads the rooms in order until the page is full, so browsing costs the
+// same for any number of rooms. The filters are checked on the way, at most LOBBY_SCAN_LIMIT rooms are looked at.
+
+// The place of an open room in an order. The serial makes every key unique. membership.lock must be held.
+uint64_t roomKey(int slot, LobbySort sort)
+{
+    uint64_t serial = membership.room_serials[slot];
+    if (sort == LOBBY_BY_FILL)
+    {
+        // The free seats are above the serial, a room needs less than 2^40 rooms before it
+        uint64_t free_seats = (uint64_t)(membership.room_players[slot] - membership.room_joined[slot]);
+        return (free_seats << 40) | (serial & ((1ull << 40) - 1));
+    }
+    return serial;
+}
+
+// The treap priority of a slot, the same mix of bits the ranking uses
+uint32_t roomPriority(int slot)
+{
+    uint64_t mixed = (uint64_t)slot + 0x9E3779B97F4A7C15ull;
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)(mixed ^ (mixed >> 31));
+}
+
+// Split a subtree into the rooms with a smaller key and the others
+void splitLobby(LobbyOrder *order, int node, uint64_t key, int *before, int *after)
+{
+    if (node == 0)
+    {
+        *before = 0;
+        *after = 0;
+        return;
+    }
+    if (order->keys[node] < key)
+    {
+        splitLobby(order, order->right[node], key, &order->right[node], after);
+        *before = node;
+    }
+    else
+    {
+        splitLobby(order, order->left[node], key, before, &order->left[node]);
+        *after = node;
+    }
+}
+
+// Join two subtrees, every key in before is smaller than every key in after. Returns the root.
+int mergeLobby(LobbyOrder *order, int before, int after)
+{
+    if (before == 0)
+    {
+        return after;
+    }
+    if (after == 0)
+    {
+        return before;
+    }
+    if (roomPriority(before) > roomPriority(after))
+    {
+        order->right[before] = mergeLobby(order, order->right[before], after);
+        return before;
+    }
+    order->left[after] = mergeLobby(order, before, order->left[after]);
+    return after;
+}
+
+// Remove the first room of a subtree. Returns the new root.
+int removeFirstRoom(LobbyOrder *order, int node)
+{
+    if (order->left[node] == 0)
+    {
+        return order->right[node];
+    }
+    order->left[node] = removeFirstRoom(order, order->left[node]);
+    return node;
+}
+
+void insertRoom(LobbyOrder *order, int slot, uint64_t key)
+{
+    order->keys[slot] = key;
+    order->left[slot] = 0;
+    order->right[slot] = 0;
+    int before, after;
+    splitLobby(order, order->root, key, &before, &after);
+    order->root = mergeLobby(order, mergeLobby(order, before, slot), after);
+}
+
+void removeRoom(LobbyOrder *order, int slot)
+{
+    int before, after;
+    splitLobby(order, order->root, order->keys[slot], &before, &after);
+    // The room is the first one that does not have a smaller key
+    order->root = mergeLobby(order, before, removeFirstRoom(order, after));
+}
+
+// A player joined a room that is not full yet, so it moves in the fill order. The lock of the game must be held.
+void fillRoom(const Game *game)
+{
+    int slot = gameSlot(game->id);
+    pthread_mutex_lock(&membership.lock);
+    if (membership.open[slot / 64] & (1ull << (slot % 64)))
+    {
+        removeRoom(&membership.by_fill, slot);
+        membership.room_joined[slot] = game->num_joined_players;
+        insertRoom(&membership.by_fill, slot, roomKey(slot, LOBBY_BY_FILL));
+    }
+    pthread_mutex_unlock(&membership.lock);
+}
+
+// Add the rooms of a subtree after the cursor that match the query to the page, in order. Returns false when the page
+// is full or the scan limit is reached, then next_cursor is the key of the last room looked at.
+bool walkLobby(const LobbyOrder *order, int node, const LobbyQuery *query, const uint64_t joined[], LobbyPage *page, int *scanned)
+{
+    if (node == 0)
+    {
+        return true;
+    }
+    uint64_t key = order->keys[node];
+    // The left subtree only has smaller keys, it is skipped if the cursor is past this room
+    if (key > query->cursor && !walkLobby(order, order->left[node], query, joined, page, scanned))
+    {
+        return false;
+    }
+    if (key > query->cursor)
+    {
+        int free_seats = membership.room_players[node] - membership.room_joined[node];
+        if (!(joined[node / 64] & (1ull << (node % 64))) &&
+            (query->num_players == 0 || membership.room_players[node] == query->num_players) &&
+            (query->num_rounds == 0 || membership.room_rounds[node] == query->num_rounds) && free_seats >= query->min_free)
+        {
+            page->rooms[page->count++] = (LobbyRoom){membership.open_ids[node], membership.room_joined[node],
+                                                     membership.room_players[node], membership.room_rounds[node]};
+        }
+        if (page->count == query->count || ++*scanned == LOBBY_SCAN_LIMIT)
+        {
+            page->next_cursor = key;
+            return false;
+        }
+    }
+    return walkLobby(order, order->right[node], query, joined, page, scanned);
+}
+
+// True if the order has a room with a key larger than key
+bool roomAfter(const LobbyOrder *order, uint64_t key)
+{
+    for (int node = order->root; node != 0; node = order->right[node])
+    {
+        if (order->keys[node] > key)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A page of the rooms the client can join. A room that fills up while the client pages through the fill order moves
+// up, so it can be skipped or shown twice, like a room that opens behind the cursor is only seen on the next pass.
+void queryLobby(const char *client_name, const LobbyQuery *query, LobbyPage *page)
+{
+    int player_id = playerId(client_name);
+    uint64_t joined[MAX_GAMES / 64];
+    int scanned = 0;
+    memset(page, 0, sizeof(*page));
+    pthread_mutex_lock(&membership.lock);
+    markJoinedRooms(player_id, joined);
+    const LobbyOrder *order = query->sort == LOBBY_BY_FILL ? &membership.by_fill : &membership.by_age;
+    walkLobby(order, order->root, query, joined, page, &scanned);
+    // A page that ends on the last room is the last page
+    if (page->next_cursor != 0 && !roomAfter(order, page->next_cursor))
+    {
+        page->next_cursor = 0;
+    }
+    pthread_mutex_unlock(&membership.lock);
+}
+
+// --------------------------------------------------------
+// --------------------- LEADERBOARD ----------------------
+// --------------------------------------------------------
+
+// The registered players are also kept in a treap ordered like the leaderboard: more points first, then by name.
+// When a game ends its players are moved in O(log n), and the top of the leaderboard and the place of a player are
+// found in O(log n) too, so the LT command does not depend on the number of players. players_lock protects it.
+
+// True if player a is above player b on the leaderboard
+bool rankedBefore(int a, int b)
+{
+    if (players[a].score != players[b].score)
+    {
+        return players[a].score > players[b].score;
+    }
+    return strcmp(players[a].name, players[b].name) < 0;
+}
+
+void updateRankSize(int node)
+{
+    int left = rank_nodes[node].left;
+    int right = rank_nodes[node].right;
+    rank_nodes[node].size = 1 + (left >= 0 ? rank_nodes[left].size : 0) + (right >= 0 ? rank_nodes[right].size : 0);
+}
+
+// Split a subtree into the players above player_id and the others
+void splitRanking(int node, int player_id, int *before, int *after)
+{
+    if (node < 0)
+    {
+        *before = -1;
+        *after = -1;
+        return;
+    }
+    if (rankedBefore(node, player_id))
+    {
+        splitRanking(rank_nodes[node].right, player_id, &rank_nodes[node].right, after);
+        *before = node;
+    }
+    else
+    {
+        splitRanking(rank_nodes[node].left, player_id, before, &rank_nodes[node].left);
+        *after = node;
+    }
+    updateRankSize(node);
+}
+
+// Join two subtrees, every player in before is above every player in after. Returns the root.
+int mergeRanking(int before, int after)
+{
+    if (before < 0)
+    {
+        return after;
+    }
+    if (after < 0)
+    {
+        return before;
+    }
+    if (rank_nodes[before].priority > rank_nodes[after].priority)
+    {
+        rank_nodes[before].right = mergeRanking(rank_nodes[before].right, after);
+        updateRankSize(before);
+        return before;
+    }
+    rank_nodes[after].left = mergeRanking(before, rank_nodes[after].left);
+    updateRankSize(after);
+    return after;
+}
+
+// Remove the highest ranked player of a subtree. Returns the new root.
+int removeFirstRanked(int node)
+{
+    if (rank_nodes[node].left < 0)
+    {
+        return rank_nodes[node].right;
+    }
+    rank_nodes[node].left = removeFirstRanked(rank_nodes[node].left);
+    updateRankSize(node);
+    return node;
+}
+
+// Put a player into the ranking at the place of its score. players_lock must be held for writing.
+void rankPlayer(int player_id)
+{
+    // The priority only has to look random, a mix of the ID is enough and the same player always gets the same one
+    uint64_t mixed = (uint64_t)player_id + 0x9E3779B97F4A7C15ull;
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+    rank_nodes[player_id] = (RankNode){-1, -1, 1, (uint32_t)(mixed ^ (mixed >> 31))};
+    int before, after;
+    splitRanking(rank_root, player_id, &before, &after);
+    rank_root = mergeRanking(mergeRanking(before, player_id), after);
+}
+
+// Take a player out of the ranking, before its score changes. players_lock must be held for writing.
+void unrankPlayer(int player_id)
+{
+    int before, after;
+    splitRanking(rank_root, player_id, &before, &after);
+    // The player is the first one that is not above itself
+    rank_root = mergeRanking(before, removeFirstRanked(after));
+}
+
+// Add points to a registered player and move it to its new place. players_lock must be held for writing.
+void addPlayerPoints(int player_id, int points)
+{
+    if (points == 0)
+    {
+        return;
+    }
+    unrankPlayer(player_id);
+    players[player_id].score += points;
+    rankPlayer(player_id);
+}
+
+// The number of players above a registered player. players_lock must be held.
+int playerRank(int player_id)
+{
+    int rank = 0;
+    int node = rank_root;
+    while (node >= 0)
+    {
+        int left = rank_nodes[node].left;
+        int left_size = left >= 0 ? rank_nodes[left].size : 0;
+        if (node == player_id)
+        {
+            return rank + left_size;
+        }
+        if (rankedBefore(node, player_id))
+        {
+            rank += left_size + 1;
+            node = rank_nodes[node].right;
+        }
+        else
+        {
+            node = left;
+        }
+    }
+    return -1;
+}
+
+// The ID of the player with rank players above it, -1 if there are not that many players. players_lock must be held.
+int rankedPlayer(int rank)
+{
+    int node = rank_root;
+    while (node >= 0)
+    {
+        int left = rank_nodes[node].left;
+        int left_size = left >= 0 ? rank_nodes[left].size : 0;
+        if (rank == left_size)
+        {
+            return node;
+        }
+        if (rank < left_size)
+        {
+            node = left;
+        }
+        else
+        {
+            rank -= left_size + 1;
+            node = rank_nodes[node].right;
+        }
+    }
+    return -1;
+}
+
+// Copy the players with ranks first..last-1 (from 0) of a subtree whose first player has rank offset. The subtrees
+// outside of the range are skipped by their size, so this visits O(log n + last - first) nodes. players_lock must be held.
+void collectRanked(int node, int offset, int first, int last, Player ranked[], int *count)
+{
+    if (node < 0)
+    {
+        return;
+    }
+    int left = rank_nodes[node].left;
+    int rank = offset + (left >= 0 ? rank_nodes[left].size : 0);
+    if (first < rank)
+    {
+        collectRanked(left, offset, first, last, ranked, count);
+    }
+    if (rank >= first && rank < last)
+    {
+        ranked[(*count)++] = players[node];
+    }
+    if (last > rank + 1)
+    {
+        collectRanked(rank_nodes[node].right, rank + 1, first, last, ranked, count);
+    }
+}
+
+// The first count players of the leaderboard and the place of the client
+void getLeaderBoardTop(const char *client_name, int count, LeaderBoardTop *top)
+{
+    uint64_t key = playerKey(client_name);
+    memset(top, 0, sizeof(*top));
+    pthread_rwlock_rdlock(&players_lock);
+    top->num_ranked = num_registered;
+    collectRanked(rank_root, 0, 0, count < MAX_LEADERBOARD_TOP ? count : MAX_LEADERBOARD_TOP, top->top, &top->count);
+    int player_id = lookupPlayer(key);
+    if (player_id >= 0 && players[player_id].registered)
+    {
+        top->my_rank = playerRank(player_id) + 1;
+        top->me = players[player_id];
+    }
+    pthread_rwlock_unlock(&players_lock);
+}
+
+// count players of the leaderboard from rank first (from 0). The page is empty after the last player.
+void getLeaderBoardPage(long first, int count, LeaderBoardPage *page)
+{
+    memset(page, 0, sizeof(*page));
+    if (count > MAX_LEADERBOARD_PAGE)
+    {
+        count = MAX_LEADERBOARD_PAGE;
+    }
+    pthread_rwlock_rdlock(&players_lock);
+    page->num_ranked = num_registered;
+    if (first < num_registered)
+    {
+        page->first_rank = (int)first + 1;
+        collectRanked(rank_root, 0, (int)first, (int)first + count, page->players, &page->count);
+    }
+    pthread_rwlock_unlock(&players_lock);
+}
+
+// The place of a player and the around players above and below it. The page is empty if the player is not registered.
+void getLeaderBoardAround(const char *name, int around, LeaderBoardPage *page)
+{
+    uint64_t key = playerKey(name);
+    memset(page, 0, sizeof(*page));
+    if (around > (MAX_LEADERBOARD_PAGE - 1) / 2)
+    {
+        around = (MAX_LEADERBOARD_PAGE - 1) / 2;
+    }
+    pthread_rwlock_rdlock(&players_lock);
+    page->num_ranked = num_registered;
+    int player_id = lookupPlayer(key);
+    if (player_id >= 0 && players[player_id].registered)
+    {
+        int rank = playerRank(player_id);
+        int first = rank > around ? rank - around : 0;
+        page->my_rank = rank + 1;
+        page->first_rank = first + 1;
+        collectRanked(rank_root, 0, first, rank + around + 1, page->players, &page->count);
+    }
+    pthread_rwlock_unlock(&players_lock);
+}
+
+// Number of players on the leaderboard
+int leaderBoardCount(void)
+{
+    pthread_rwlock_rdlock(&players_lock);
+    int count = num_registered;
+    pthread_rwlock_unlock(&players_lock);
+    return count;
+}
+
+// --------------------------------------------------------
+// ----------------------- TIMERS -------------------------
+// --------------------------------------------------------
+
+// A game does not wait forever for a player who left: a waiting room that does not fill up in lobby_timeout seconds
+// is closed, and the players who did not move in round_timeout seconds forfeit the round (their move stays empty).
+// The deadlines are in timer_wheel and the server loop wakes up for them.
+
+// Milliseconds of a clock that only goes forward
+uint64_t monotonicMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// The current tick of the timer wheel
+uint64_t timerNow(void)
+{
+    return monotonicMs() / TIMER_TICK_MS;
+}
+
+// Put the timer of a slot into the bucket of its expiry. The lock of the wheel must be held.
+void linkTimer(int slot)
+{
+    uint64_t expires = timer_wheel.expires[slot];
+    if (expires < timer_wheel.tick)
+    {
+        expires = timer_wheel.tick;
+    }
+    // A timer further away than the wheel reaches waits in the last bucket and is moved down from there
+    uint64_t reach = 1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+    if (expires - timer_wheel.tick >= reach)
+    {
+        expires = timer_wheel.tick + reach - 1;
+    }
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && expires - timer_wheel.tick >= 1ull << (TIMER_WHEEL_BITS * (level + 1)))
+    {
+        level++;
+    }
+    int bucket = level * TIMER_WHEEL_SIZE + (int)((expires >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SIZE - 1));
+    timer_wheel.prev[slot] = 0;
+    timer_wheel.next[slot] = timer_wheel.heads[bucket];
+    if (timer_wheel.heads[bucket] != 0)
+    {
+        timer_wheel.prev[timer_wheel.heads[bucket]] = slot;
+    }
+    timer_wheel.heads[bucket] = slot;
+    timer_wheel.bucket[slot] = bucket + 1;
+}
+
+// Take the timer of a slot out of its bucket. The lock of the wheel must be held.
+void unlinkTimer(int slot)
+{
+    int next = timer_wheel.next[slot];
+    int prev = timer_wheel.prev[slot];
+    if (prev != 0)
+    {
+        timer_wheel.next[prev] = next;
+    }
+    else
+    {
+        timer_wheel.heads[timer_wheel.bucket[slot] - 1] = next;
+    }
+    if (next != 0)
+    {
+        timer_wheel.prev[next] = prev;
+    }
+    timer_wheel.bucket[slot] = 0;
+}
+
+// Set the deadline of a game to the tick expires. It replaces the deadline the game had.
+void armGameTimer(int game_id, int round, uint64_t expires)
+{
+    int slot = gameSlot(game_id);
+    if (slot == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&timer_wheel.lock);
+    bool first = false;
+    if (timer_wheel.bucket[slot] != 0)
+    {
+        unlinkTimer(slot);
+    }
+    else
+    {
+        // An empty wheel is not turned by the loop, it starts again from now
+        if (timer_wheel.count == 0)
+        {
+            timer_wheel.tick = timerNow();
+            first = true;
+        }
+        timer_wheel.count++;
+    }
+    timer_wheel.expires[slot] = expires;
+    timer_wheel.deadlines[slot] = (GameDeadline){game_id, round};
+    linkTimer(slot);
+    pthread_mutex_unlock(&timer_wheel.lock);
+    // The loop sleeps without a timeout while there are no timers
+    if (first)
+    {
+        wakeServerLoop();
+    }
+}
+
+void cancelGameTimer(int game_id)
+{
+    int slot = gameSlot(game_id);
+    pthread_mutex_lock(&timer_wheel.lock);
+    if (slot != 0 && timer_wheel.bucket[slot] != 0)
+    {
+        unlinkTimer(slot);
+        timer_wheel.count--;
+    }
+    pthread_mutex_unlock(&timer_wheel.lock);
+}
+
+// Arm the deadline of the phase the game is in. The lock of the game must be held, the wheel is locked after it.
+void setGameDeadline(Game *game)
+{
+    // Without timeouts the wheel is never used
+    if (round_timeout == 0 && lobby_timeout == 0)
+    {
+        return;
+    }
+    int timeout = game->phase == GAME_WAITING ? lobby_timeout : game->phase == GAME_PLAYING ? round_timeout : 0;
+    if (timeout == 0)
+    {
+        cancelGameTimer(game->id);
+        return;
+    }
+    int round = game->phase == GAME_PLAYING ? game->current_round : 0;
+    armGameTimer(game->id, round, timerNow() + (uint64_t)timeout * 1000 / TIMER_TICK_MS);
+}
+
+// Turn the wheel to the tick now and put the deadlines that expired into expired (one per slot at most).
+// Returns the number of expired deadlines.
+int advanceTimers(uint64_t now, GameDeadline expired[])
+{
+    int count = 0;
+    pthread_mutex_lock(&timer_wheel.lock);
+    while (timer_wheel.tick <= now && timer_wheel.count > 0)
+    {
+        uint64_t tick = timer_wheel.tick;
+        // When a level goes around, the next bucket of the level above is spread over the levels below it
+        for (int level = 1; level < TIMER_WHEEL_LEVELS && (tick & ((1ull << (TIMER_WHEEL_BITS * level)) - 1)) == 0; level++)
+        {
+            int bucket = level * TIMER_WHEEL_SIZE + (int)((tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SIZE - 1));
+            int slot = timer_wheel.heads[bucket];
+            timer_wheel.heads[bucket] = 0;
+            while (slot != 0)
+            {
+                int next = timer_wheel.next[slot];
+                linkTimer(slot);
+                slot = next;
+            }
+        }
+        // Every timer in the bucket of this tick in level 0 expires now
+        int bucket = (int)(tick & (TIMER_WHEEL_SIZE - 1));
+        int slot = timer_wheel.heads[bucket];
+        timer_wheel.heads[bucket] = 0;
+        while (slot != 0)
+        {
+            expired[count++] = timer_wheel.deadlines[slot];
+            timer_wheel.bucket[slot] = 0;
+            timer_wheel.count--;
+            slot = timer_wheel.next[slot];
+        }
+        timer_wheel.tick++;
+    }
+    pthread_mutex_unlock(&timer_wheel.lock);
+    return count;
+}
+
+// Milliseconds until the wheel has to turn, -1 if there are no timers
+int timerTimeout(void)
+{
+    pthread_mutex_lock(&timer_wheel.lock);
+    int timeout = -1;
+    if (timer_wheel.count > 0)
+    {
+        uint64_t due = timer_wheel.tick * TIMER_TICK_MS;
+        uint64_t now = monotonicMs();
+        timeout = due > now ? (int)(due - now) : 0;
+    }
+    pthread_mutex_unlock(&timer_wheel.lock);
+    return timeout;
+}
+
+// Handle the deadlines that expired by the tick now. Called by the server loop. Returns the number of expired deadlines.
+int expireTimers(uint64_t now)
+{
+    GameDeadline expired[MAX_GAMES];
+    int count = advanceTimers(now, expired);
+    for (int i = 0; i < count; i++)
+    {
+        expireGameDeadline(expired[i]);
+    }
+    return count;
+}
+
+// Close the waiting room or end the round of an expired deadline. The game may have moved on since the deadline was
+// taken from the wheel, then nothing happens.
+void expireGameDeadline(GameDeadline deadline)
+{
+    Game *game = lockGame(deadline.game_id);
+    if (game == NULL)
+    {
+        return;
+    }
+    bool closed = false;
+    bool forfeited = false;
+    if (deadline.round == 0 && game->phase == GAME_WAITING)
+    {
+        // The game was not played, so the leaderboard does not change
+        game->phase = GAME_FINISHED;
+        game->active = false;
+        closeGameMembership(game);
+        touchGame(game, &game->state_version);
+        closed = true;
+    }
+    else if (deadline.round > 0 && game->phase == GAME_PLAYING && game->current_round == deadline.round)
+    {
+        // The players who did not move get an empty move: no points for them and nobody beats them
+        for (int i = 0; i < game->num_players; i++)
+        {
+            forfeited = submitMove(game, deadline.round - 1, i, MOVE_NONE) || forfeited;
+        }
+        if (forfeited)
+        {
+            atomic_fetch_add(&game->version, 1);
+        }
+    }
+    pthread_mutex_unlock(&game->lock);
+    if (closed)
+    {
+        printf("Game %d expired in the waiting room\n", deadline.game_id);
+        notifyGameChanged(deadline.game_id);
+        retireGame(deadline.game_id);
+    }
+    if (forfeited)
+    {
+        printf("Round %d of game %d timed out\n", deadline.round, deadline.game_id);
+        notifyGameChanged(deadline.game_id);
+        scheduleGame(deadline.game_id);
+    }
+}
+
+// Remove every timer. Used when the games are reset.
+void resetTimers(void)
+{
+    pthread_mutex_lock(&timer_wheel.lock);
+    memset(timer_wheel.heads, 0, sizeof(timer_wheel.heads));
+    memset(timer_wheel.bucket, 0, sizeof(timer_wheel.bucket));
+    timer_wheel.count = 0;
+    pthread_mutex_unlock(&timer_wheel.lock);
+}
+
+// --------------------------------------------------------
+// ---------------------- MESSAGES ------------------------
+// --------------------------------------------------------
+
+// Every message is a FrameHeader followed by header.length bytes of payload. Because the length is known,
+// messages can be split from any stream: many of them can arrive in one read and one can arrive in many reads.
+
+// Find the CommandCode of a control code. Returns CMD_NONE if it is unknown.
+CommandCode findCommandCode(const char *control, size_t length)
+{
+    for (int i = 1; i < CMD_COUNT; i++)
+    {
+        if (strlen(command_table[i].code) == length && strncmp(command_table[i].code, control, length) == 0)
+        {
+            return (CommandCode)i;
+        }
+    }
+    return CMD_NONE;
+}
+
+// Write a message into buffer, which has to hold sizeof(FrameHeader) + length bytes. Returns the size of the message.
+size_t encodeFrame(char *buffer, CommandCode command, uint32_t correlation_id, uint16_t flags, const char *sender, const char *payload, size_t length)
+{
+    FrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.length = (uint32_t)length;
+    header.command = (uint16_t)command;
+    header.flags = flags;
+    header.correlation_id = correlation_id;
+    if (sender != NULL)
+    {
+        strncpy(header.sender, sender, sizeof(header.sender) - 1);
+    }
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), payload, length);
+    return sizeof(header) + length;
+}
+
+// Read the message at the start of data. Returns false if data does not contain one complete message.
+bool decodeFrame(const char *data, size_t length, FrameHeader *header, const char **payload)
+{
+    if (length < sizeof(FrameHeader))
+    {
+        return false;
+    }
+    memcpy(header, data, sizeof(FrameHeader));
+    header->sender[sizeof(header->sender) - 1] = '\0';
+    if (length - sizeof(FrameHeader) < header->length)
+    {
+        return false;
+    }
+    *payload = data + sizeof(FrameHeader);
+    return true;
+}
+
+// Make room for at least size more bytes and return where they can be written.
+// The messages already handed out are dropped here, so their payloads are only valid until this is called.
+char *frameReaderReserve(FrameReader *reader, size_t size)
+{
+    reader->length -= reader->consumed;
+    memmove(reader->buffer, reader->buffer + reader->consumed, reader->length);
+    reader->consumed = 0;
+    if (reader->length + size > reader->capacity)
+    {
+        size_t capacity = reader->capacity == 0 ? BUFSIZ : reader->capacity;
+        while (capacity < reader->length + size)
+        {
+            capacity *= 2;
+        }
+        char *buffer = realloc(reader->buffer, capacity);
+        if (buffer == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        reader->buffer = buffer;
+        reader->capacity = capacity;
+    }
+    return reader->buffer + reader->length;
+}
+
+// Add the bytes written after frameReaderReserve()
+void frameReaderCommit(FrameReader *reader, size_t length)
+{
+    reader->length += length;
+}
+
+// Take the next complete message out of the reader.
+// Returns 1 if there was one, 0 if more data is needed and -1 if the stream is broken (the reader is emptied).
+int frameReaderNext(FrameReader *reader, FrameHeader *header, const char **payload)
+{
+    const char *data = reader->buffer + reader->consumed;
+    size_t available = reader->length - reader->consumed;
+    if (available >= sizeof(FrameHeader))
+    {
+        uint32_t length;
+        memcpy(&length, data, sizeof(length));
+        if (length > MAX_FRAME_PAYLOAD)
+        {
+            fprintf(stderr, "Error: Message too long\n");
+            reader->length = 0;
+            reader->consumed = 0;
+            return -1;
+        }
+    }
+    if (!decodeFrame(data, available, header, payload))
+    {
+        return 0;
+    }
+    reader->consumed += sizeof(FrameHeader) + header->length;
+    return 1;
+}
+
+void frameReaderFree(FrameReader *reader)
+{
+    free(reader->buffer);
+    reader->buffer = NULL;
+    reader->length = 0;
+    reader->capacity = 0;
+    reader->consumed = 0;
+}
+
+// Append data to the string. The string is always null terminated.
+bool builderAppend(StringBuilder *builder, const char *data, size_t length)
+{
+    if (builder->length + length + 1 > builder->capacity)
+    {
+        size_t capacity = builder->capacity == 0 ? 64 : builder->capacity;
+        while (capacity < builder->length + length + 1)
+        {
+            capacity *= 2;
+        }
+        char *buffer = realloc(builder->data, capacity);
+        if (buffer == NULL)
+        {
+            fprintf(stderr, "Error allocating memory\n");
+            return false;
+        }
+        builder->data = buffer;
+        builder->capacity = capacity;
+    }
+    memcpy(builder->data + builder->length, data, length);
+    builder->length += length;
+    builder->data[builder->length] = '\0';
+    return true;
+}
+
+// Append formatted text to the string
+bool builderPrintf(StringBuilder *builder, const char *format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0 || (size_t)length >= sizeof(text))
+    {
+        return false;
+    }
+    return builderAppend(builder, text, (size_t)length);
+}
+
+// --------------------------------------------------------
+// ---------------------- ENCODING ------------------------
+// --------------------------------------------------------
+
+// Binary encoding of the responses a client asks for with FRAME_FLAG_BINARY. The server and the client share it.
+// Numbers are varints (7 bits per byte, the high bit means more bytes follow), player IDs are PLAYER_ID_WIDTH bytes
+// and the moves of a round are packed with 2 bits per player. Nothing is allocated and everything is read and
+// written in one pass.
+
+// Write value as a varint. buffer needs 5 bytes. Returns the number of bytes written.
+size_t putVarint(uint8_t *buffer, uint32_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    return length;
+}
+
+// Read a varint at cursor and move the cursor after it. Returns false if the data ends before the varint.
+bool getVarint(const uint8_t **cursor, const uint8_t *end, uint32_t *value)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && *cursor < end; shift += 7)
+    {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The same for 64 bit numbers, at most 10 bytes
+size_t putVarint64(uint8_t *buffer, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+    return length;
+}
+
+bool getVarint64(const uint8_t **cursor, const uint8_t *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 70 && *cursor < end; shift += 7)
+    {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool builderAppendVarint(StringBuilder *builder, uint32_t value)
+{
+    uint8_t buffer[5];
+    return builderAppend(builder, (const char *)buffer, putVarint(buffer, value));
+}
+
+MoveCode moveCode(char decision)
+{
+    switch (decision)
+    {
+    case 'r':
+        return MOVE_ROCK;
+    case 'p':
+        return MOVE_PAPER;
+    case 's':
+        return MOVE_SCISSORS;
+    default:
+        return MOVE_NONE;
+    }
+}
+
+char moveChar(MoveCode move)
+{
+    return "nrps"[move & 3];
+}
+
+// The move of a lane (a player) in a round word (see Game.round_moves)
+MoveCode roundMove(uint32_t moves, int lane)
+{
+    return (MoveCode)((moves >> (lane * 2)) & 3);
+}
+
+// The mask of the players who moved in a round word, bit i is player i
+uint32_t roundSubmitted(uint32_t moves)
+{
+    return moves >> ROUND_SUBMITTED_SHIFT;
+}
+
+// Build a round word from one character per player, like the rounds of getGameInfo(): "rpn"
+uint32_t packRoundMoves(const char *decisions)
+{
+    uint32_t moves = 0;
+    for (int i = 0; decisions[i] != '\0' && i < ROUND_WORD_PLAYERS; i++)
+    {
+        MoveCode move = moveCode(decisions[i]);
+        if (move != MOVE_NONE)
+        {
+            moves |= (1u << (ROUND_SUBMITTED_SHIFT + i)) | ((uint32_t)move << (i * 2));
+        }
+    }
+    return moves;
+}
+
+// Encode a game: <started> and if started <num_players><current_round><num_rounds><ids><scores><moves of every round>
+// The caller holds the lock. buffer needs GAME_INFO_MAX_SIZE bytes. Returns the number of bytes written.
+size_t encodeGameInfo(const Game *game, uint8_t *buffer)
+{
+    size_t length = 0;
+    buffer[length++] = game->started ? 1 : 0;
+    if (!game->started)
+    {
+        return length;
+    }
+    int num_rounds = playedRounds(game->current_round, game->num_rounds);
+    length += putVarint(buffer + length, (uint32_t)game->num_players);
+    length += putVarint(buffer + length, (uint32_t)game->current_round);
+    length += putVarint(buffer + length, (uint32_t)game->num_rounds);
+    for (int i = 0; i < game->num_players; i++)
+    {
+        // strncpy pads the shorter IDs with zeros
+        strncpy((char *)buffer + length, game->playerNames[i], PLAYER_ID_WIDTH);
+        length += PLAYER_ID_WIDTH;
+    }
+    for (int i = 0; i < game->num_players; i++)
+    {
+        length += putVarint(buffer + length, (uint32_t)game->playerScores[i]);
+    }
+    int round_size = (game->num_players + 3) / 4;
+    for (int round = 0; round < num_rounds; round++)
+    {
+        memset(buffer + length, 0, (size_t)round_size);
+        for (int i = 0; i < game->num_players; i++)
+        {
+            buffer[length + i / 4] |= (uint8_t)(gameMove(game, round, i) << ((i % 4) * 2));
+        }
+        length += (size_t)round_size;
+    }
+    return length;
+}
+
+// Decode a game encoded by encodeGameInfo(). The view points into data. Returns false if the data is invalid.
+bool decodeGameInfo(const uint8_t *data, size_t length, GameInfoView *view)
+{
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + length;
+    memset(view, 0, sizeof(*view));
+    if (cursor == end)
+    {
+        return false;
+    }
+    view->started = *cursor++ != 0;
+    if (!view->started)
+    {
+        return true;
+    }
+    uint32_t num_players, current_round, num_rounds;
+    if (!getVarint(&cursor, end, &num_players) || !getVarint(&cursor, end, &current_round) || !getVarint(&cursor, end, &num_rounds))
+    {
+        return false;
+    }
+    if (num_players > MAX_GAME_PLAYERS || num_rounds > MAX_GAME_ROUNDS || (size_t)(end - cursor) < num_players * PLAYER_ID_WIDTH)
+    {
+        return false;
+    }
+    view->num_players = (int)num_players;
+    view->current_round = (int)current_round;
+    view->num_rounds = (int)num_rounds;
+    view->player_ids = (const char *)cursor;
+    cursor += num_players * PLAYER_ID_WIDTH;
+    for (int i = 0; i < view->num_players; i++)
+    {
+        uint32_t score;
+        if (!getVarint(&cursor, end, &score))
+        {
+            return false;
+        }
+        view->scores[i] = (int)score;
+    }
+    view->round_size = (view->num_players + 3) / 4;
+    int encoded_rounds = playedRounds(view->current_round, view->num_rounds);
+    if ((size_t)(end - cursor) < (size_t)(encoded_rounds * view->round_size))
+    {
+        return false;
+    }
+    view->moves = cursor;
+    return true;
+}
+
+// The move of a player in a round (0 based) as 'r', 'p', 's' or 'n' if there is none
+char gameInfoMove(const GameInfoView *view, int round, int player)
+{
+    if (round >= playedRounds(view->current_round, view->num_rounds))
+    {
+        return 'n';
+    }
+    uint8_t byte = view->moves[round * view->round_size + player / 4];
+    return moveChar((MoveCode)((byte >> ((player % 4) * 2)) & 3));
+}
+
+// Copy the ID of a player as a null terminated string
+void gameInfoPlayer(const GameInfoView *view, int player, char name[PLAYER_ID_WIDTH + 1])
+{
+    memcpy(name, view->player_ids + player * PLAYER_ID_WIDTH, PLAYER_ID_WIDTH);
+    name[PLAYER_ID_WIDTH] = '\0';
+}
+
+// Encode what changed in a game since the version the client has: <version><kind> and
+// kind 0: the full game info, it is sent if the client has nothing yet or is too far behind
+// kind 1: <parts> and the changed parts: DELTA_STATE <started><num_players><current_round><num_rounds>,
+//         DELTA_PLAYERS <ids>, DELTA_SCORES <scores>, DELTA_ROUNDS <count> and <round><moves> for every changed round
+// The caller holds the lock. buffer needs GAME_DELTA_MAX_SIZE bytes. Returns the number of bytes written.
+size_t encodeGameDelta(const Game *game, uint32_t since, uint8_t *buffer)
+{
+    // Read once: a move can increment it meanwhile, then the client gets that move again with the next delta
+    uint32_t version = atomic_load(&game->version);
+    size_t length = putVarint(buffer, version);
+    if (since == 0 || since > version || version - since > GAME_DELTA_MAX_GAP)
+    {
+        buffer[length++] = 0;
+        return length + encodeGameInfo(game, buffer + length);
+    }
+    buffer[length++] = 1;
+    size_t parts_at = length++;
+    uint8_t parts = 0;
+    if (game->state_version > since)
+    {
+        parts |= DELTA_STATE;
+        buffer[length++] = game->started ? 1 : 0;
+        length += putVarint(buffer + length, (uint32_t)game->num_players);
+        length += putVarint(buffer + length, (uint32_t)game->current_round);
+        length += putVarint(buffer + length, (uint32_t)game->num_rounds);
+    }
+    // The players and the moves are only known to the clients once the game started
+    if (game->started && game->players_version > since)
+    {
+        parts |= DELTA_PLAYERS;
+        for (int i = 0; i < game->num_players; i++)
+        {
+            strncpy((char *)buffer + length, game->playerNames[i], PLAYER_ID_WIDTH);
+            length += PLAYER_ID_WIDTH;
+        }
+    }
+    if (game->started && game->scores_version > since)
+    {
+        parts |= DELTA_SCORES;
+        for (int i = 0; i < game->num_players; i++)
+        {
+            length += putVarint(buffer + length, (uint32_t)game->playerScores[i]);
+        }
+    }
+    int num_rounds = playedRounds(game->current_round, game->num_rounds);
+    int changed_rounds = 0;
+    for (int round = 0; game->started && round < num_rounds; round++)
+    {
+        changed_rounds += roundChanged(game, round, since) ? 1 : 0;
+    }
+    if (changed_rounds > 0)
+    {
+        parts |= DELTA_ROUNDS;
+        length += putVarint(buffer + length, (uint32_t)changed_rounds);
+        int round_size = (game->num_players + 3) / 4;
+        for (int round = 0; round < num_rounds; round++)
+        {
+            if (!roundChanged(game, round, since))
+            {
+                continue;
+            }
+            length += putVarint(buffer + length, (uint32_t)round);
+            memset(buffer + length, 0, (size_t)round_size);
+            for (int i = 0; i < game->num_players; i++)
+            {
+                buffer[length + i / 4] |= (uint8_t)(gameMove(game, round, i) << ((i % 4) * 2));
+            }
+            length += (size_t)round_size;
+        }
+    }
+    buffer[parts_at] = parts;
+    return length;
+}
+
+// Returns true if a round has to be in the delta since a version. The moves of the round being played are not stamped
+// (makeMove() does not take the lock), so that round is always sent.
+bool roundChanged(const Game *game, int round, uint32_t since)
+{
+    return game->round_versions[round] > since || (game->phase == GAME_PLAYING && round == game->current_round - 1);
+}
+
+// Apply a delta encoded by encodeGameDelta() to the client's copy of the game. Returns false if the data is invalid
+// or the delta does not fit the copy, the copy has to be requested again then.
+bool applyGameDelta(GameState *state, const uint8_t *data, size_t length)
+{
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + length;
+    uint32_t version;
+    if (!getVarint(&cursor, end, &version) || cursor == end)
+    {
+        return false;
+    }
+    uint8_t kind = *cursor++;
+    if (kind == 0)
+    {
+        GameInfoView view;
+        if (!decodeGameInfo(cursor, (size_t)(end - cursor), &view))
+        {
+            return false;
+        }
+        memset(state, 0, sizeof(*state));
+        state->started = view.started;
+        state->num_players = view.num_players;
+        state->current_round = view.current_round;
+        state->num_rounds = view.num_rounds;
+        for (int i = 0; i < view.num_players; i++)
+        {
+            gameInfoPlayer(&view, i, state->player_ids[i]);
+            state->scores[i] = view.scores[i];
+        }
+        for (int round = 0; view.started && round < playedRounds(view.current_round, view.num_rounds); round++)
+        {
+            memcpy(state->moves[round], view.moves + round * view.round_size, (size_t)view.round_size);
+        }
+        state->version = version;
+        return true;
+    }
+    if (kind != 1 || state->version == 0 || cursor == end)
+    {
+        return false;
+    }
+    uint8_t parts = *cursor++;
+    if (parts & DELTA_STATE)
+    {
+        uint32_t num_players, current_round, num_rounds;
+        if (cursor == end)
+        {
+            return false;
+        }
+        state->started = *cursor++ != 0;
+        if (!getVarint(&cursor, end, &num_players) || !getVarint(&cursor, end, &current_round) || !getVarint(&cursor, end, &num_rounds) ||
+            num_players > MAX_GAME_PLAYERS || num_rounds > MAX_GAME_ROUNDS)
+        {
+            return false;
+        }
+        state->num_players = (int)num_players;
+        state->current_round = (int)current_round;
+        state->num_rounds = (int)num_rounds;
+    }
+    if (parts & DELTA_PLAYERS)
+    {
+        if ((size_t)(end - cursor) < (size_t)state->num_players * PLAYER_ID_WIDTH)
+        {
+            return false;
+        }
+        for (int i = 0; i < state->num_players; i++)
+        {
+            memcpy(state->player_ids[i], cursor, PLAYER_ID_WIDTH);
+            state->player_ids[i][PLAYER_ID_WIDTH] = '\0';
+            cursor += PLAYER_ID_WIDTH;
+        }
+    }
+    if (parts & DELTA_SCORES)
+    {
+        for (int i = 0; i < state->num_players; i++)
+        {
+            uint32_t score;
+            if (!getVarint(&cursor, end, &score))
+            {
+                return false;
+            }
+            state->scores[i] = (int)score;
+        }
+    }
+    if (parts & DELTA_ROUNDS)
+    {
+        uint32_t count;
+        int round_size = (state->num_players + 3) / 4;
+        if (!getVarint(&cursor, end, &count))
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t round;
+            if (!getVarint(&cursor, end, &round) || round >= MAX_GAME_ROUNDS || (size_t)(end - cursor) < (size_t)round_size)
+            {
+                return false;
+            }
+            memcpy(state->moves[round], cursor, (size_t)round_size);
+            cursor += round_size;
+        }
+    }
+    state->version = version;
+    return true;
+}
+
+// The move of a player in a round (0 based) of the client's copy as 'r', 'p', 's' or 'n' if there is none
+char gameStateMove(const GameState *state, int round, int player)
+{
+    if (round < 0 || round >= MAX_GAME_ROUNDS)
+    {
+        return 'n';
+    }
+    return moveChar((MoveCode)((state->moves[round][player / 4] >> ((player % 4) * 2)) & 3));
+}
+
+// Encode a list of game IDs: <count><id>...
+bool encodeGameList(StringBuilder *builder, const int game_ids[], int count)
+{
+    bool success = builderAppendVarint(builder, (uint32_t)count);
+    for (int i = 0; i < count && success; i++)
+    {
+        success = builderAppendVarint(builder, (uint32_t)game_ids[i]);
+    }
+    return success;
+}
+
+// Decode a list encoded by encodeGameList(). Returns the number of IDs, -1 if the data is invalid.
+int decodeGameList(const uint8_t *data, size_t length, int game_ids[], int max_games)
+{
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + length;
+    uint32_t count;
+    if (!getVarint(&cursor, end, &count) || count > (uint32_t)max_games)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t game_id;
+        if (!getVarint(&cursor, end, &game_id))
+        {
+            return -1;
+        }
+        game_ids[i] = (int)game_id;
+    }
+    return (int)count;
+}
+
+// Encode the leaderboard: <count> and <id><score><matches> for every player
+bool encodeLeaderBoard(StringBuilder *builder)
+{
+    pthread_rwlock_rdlock(&players_lock);
+    bool success = builderAppendVarint(builder, (uint32_t)num_registered);
+    for (int i = 0; i < num_players && success; i++)
+    {
+        if (!players[i].registered)
+        {
+            continue;
+        }
+        char id[PLAYER_ID_WIDTH];
+        strncpy(id, players[i].name, PLAYER_ID_WIDTH);
+        success = builderAppend(builder, id, PLAYER_ID_WIDTH) &&
+                  builderAppendVarint(builder, (uint32_t)players[i].score) &&
+                  builderAppendVarint(builder, (uint32_t)players[i].matches);
+    }
+    pthread_rwlock_unlock(&players_lock);
+    return success;
+}
+
+// Decode a leaderboard encoded by encodeLeaderBoard(). Returns the number of players, -1 if the data is invalid.
+int decodeLeaderBoard(const uint8_t *data, size_t length, Player players[], int max_players)
+{
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + length;
+    uint32_t count;
+    if (!getVarint(&cursor, end, &count) || count > (uint32_t)max_players)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t score, matches;
+        if ((size_t)(end - cursor) < PLAYER_ID_WIDTH)
+        {
+            return -1;
+        }
+        memcpy(players[i].name, cursor, PLAYER_ID_WIDTH);
+        players[i].name[PLAYER_ID_WIDTH] = '\0';
+        cursor += PLAYER_ID_WIDTH;
+        if (!getVarint(&cursor, end, &score) || !getVarint(&cursor, end, &matches))
+        {
+            return -1;
+        }
+        players[i].score = (int)score;
+        players[i].matches = (int)matches;
+    }
+    return (int)count;
+}
+
+// Encode the answer of LT: <num_ranked><my_rank><my_score><my_matches><count> and <id><score><matches> for every player
+// of the top. buffer needs LEADERBOARD_TOP_MAX_SIZE bytes.
+size_t encodeLeaderBoardTop(const LeaderBoardTop *top, uint8_t *buffer)
+{
+    size_t length = putVarint(buffer, (uint32_t)top->num_ranked);
+    length += putVarint(buffer + length, (uint32_t)top->my_rank);
+    length += putVarint(buffer + length, (uint32_t)top->me.score);
+    length += putVarint(buffer + length, (uint32_t)top->me.matches);
+    length += putVarint(buffer + length, (uint32_t)top->count);
+    for (int i = 0; i < top->count; i++)
+    {
+        strncpy((char *)buffer + length, top->top[i].name, PLAYER_ID_WIDTH);
+        length += PLAYER_ID_WIDTH;
+        length += putVarint(buffer + length, (uint32_t)top->top[i].score);
+        length += putVarint(buffer + length, (uint32_t)top->top[i].matches);
+    }
+    return length;
+}
+
+// Decode an answer encoded by encodeLeaderBoardTop(). Returns false if the data is invalid.
+bool decodeLeaderBoardTop(const uint8_t *data, size_t length, LeaderBoardTop *top)
+{
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + length;
+    uint32_t num_ranked, my_rank, score, matches, count;
+    memset(top, 0, sizeof(*top));
+    if (!getVarint(&cursor, end, &num_ranked) || !getVarint(&cursor, end, &my_rank) || !getVarint(&cursor, end, &score) ||
+        !getVarint(&cursor, end, &matches) || !getVarint(&cursor, end, &count) || count > MAX_LEADERBOARD_TOP)
+    {
+        return false;
+    }
+    top->num_ranked = (int)num_ranked;
+    top->my_rank = (int)my_rank;
+    top->me.score = (int)score;
+    top->me.matches = (int)matches;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((size_t)(end - cursor) < PLAYER_ID_WIDTH)
+        {
+            return false;
+        }
+        memcpy(top->top[i].name, cursor, PLAYER_ID_WIDTH);
+        top->top[i].name[PLAYER_ID_WIDTH] = '\0';
+        cursor += PLAYER_ID_WIDTH;
+        if (!getVarint(&cursor, end, &score) || !getVarint(&cursor, end, &matches))
+        {
+            return false;
+        }
+        top->top[i].score = (int)score;
+        top->top[i].matches = (int)matches;
+    }
+    top->count = (int)count;
+    return true;
+}
+
+// Encode a page of the leaderboard: <num_ranked><first_rank><my_rank><count> and <id><score><matches> for every player
+// of the page. buffer needs LEADERBOARD_PAGE_MAX_SIZE bytes.
+size_t encodeLeaderBoardPage(const LeaderBoardPage *page, uint8_t *buffer)
+{
+    size_t length = putVarint(buffer, (uint32_t)page->num_ranked);
+    length += putVarint(buffer + length, (uint32_t)page->first_rank);
+    length += putVarint(buffer + length, (uint32_t)page->my_rank);
+    length += putVarint(buffer + length, (uint32_t)page->count);
+    for (int i = 0; i < page->count; i++)
+    {
+        strncpy((char *)buffer + length, page->players[i].name, PLAYER_ID_WIDTH);
+        length += PLAYER_ID_WIDTH;
+        length += putVarint(buffer + length, (uint32_t)page->players[i].score);
+        length += putVarint(buffer + length, (uint32_t)page->players[i].matches);
+    }
+    return length;
+}
+
+// Decode a page encoded by encodeLeaderBoardPage(). Returns false if the data is invalid.
+bool decodeLeaderBoardPage(const uint8_t *data, size_t length, LeaderBoardPage *page)
+{
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + length;
+    uint32_t num_ranked, first_rank, my_rank, count, score, matches;
+    memset(page, 0, sizeof(*page));
+    if (!getVarint(&cursor, end, &num_ranked) || !getVarint(&cursor, end, &first_rank) || !getVarint(&cursor, end, &my_rank) ||
+        !getVarint(&cursor, end, &count) || count > MAX_LEADERBOARD_PAGE)
+    {
+        return false;
+    }
+    page->num_ranked = (int)num_ranked;
+    page->first_rank = (int)first_rank;
+    page->my_rank = (int)my_rank;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((size_t)(end - cursor) < PLAYER_ID_WIDTH)
+        {
+            return false;
+        }
+        memcpy(page->players[i].name, cursor, PLAYER_ID_WIDTH);
+        page->players[i].name[PLAYER_ID_WIDTH] = '\0';
+        cursor += PLAYER_ID_WIDTH;
+        if (!getVarint(&cursor, end, &score) || !getVarint(&cursor, end, &matches))
+        {
+            return false;
+        }
+        page->players[i].score = (int)score;
+        page->players[i].matches = (int)matches;
+    }
+    page->count = (int)count;
+    return true;
+}
+
+// Encode a page of the lobby: <next_cursor><count> and <game_id><num_joined><num_players><num_rounds> for every room.
+// buffer needs LOBBY_PAGE_MAX_SIZE bytes.
+size_t encodeLobbyPage(const LobbyPage *page, uint8_t *buffer)
+{
+    size_t length = putVarint64(buffer, page->next_cursor);
+    length += putVarint(buffer + length, (uint32_t)page->count);
+    for (int i = 0; i < page->count; i++)
+    {
+        length += putVarint(buffer + length, (uint32_t)page->rooms[i].game_id);
+        length += putVarint(buffer + length, (uint32_t)page->rooms[i].num_joined);
+        length += putVarint(buffer + length, (uint32_t)page->rooms[i].num_players);
+        length += putVarint(buffer + length, (uint32_t)page->rooms[i].num_rounds);
+    }
+    return length;
+}
+
+// Decode a page encoded by encodeLobbyPage(). Returns false if the data is invalid.
+bool decodeLobbyPage(const uint8_t *data, size_t length, LobbyPage *page)
+{
+    const uint8_t *cursor = data;
+    const uint8_t *end = data + length;
+    uint32_t count;
+    memset(page, 0, sizeof(*page));
+    if (!getVarint64(&cursor, end, &page->next_cursor) || !getVarint(&cursor, end, &count) || count > MAX_LOBBY_PAGE)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t game_id, num_joined, num_players, num_rounds;
+        if (!getVarint(&cursor, end, &game_id) || !getVarint(&cursor, end, &num_joined) ||
+            !getVarint(&cursor, end, &num_players) || !getVarint(&cursor, end, &num_rounds))
+        {
+            return false;
+        }
+        page->rooms[i] = (LobbyRoom){(int)game_id, (int)num_joined, (int)num_players, (int)num_rounds};
+    }
+    page->count = (int)count;
+    return true;
+}
+
+// Find the connection of a client. Returns NULL if the client has no open response channel.
+Connection *findConnection(const char *client_name)
+{
+    for (int i = 0; i < MAX_CONNECTIONS; i++)
+    {
+        if (connections[i].active && connections[i].name[0] != '\0' && strcmp(connections[i].name, client_name) == 0)
+        {
+            return &connections[i];
+        }
+    }
+    return NULL;
+}
+
+// Put a newly opened channel into the connection table and start watching it.
+// watch_events are the events the loop always waits for on this channel (reading for bidirectional channels).
+Connection *allocateConnection(int fd, int watch_events)
+{
+    for (int i = 0; i < MAX_CONNECTIONS; i++)
+    {
+        if (!connections[i].active)
+        {
+            Connection *connection = &connections[i];
+            connection->name[0] = '\0';
+            connection->response_fd = fd;
+            connection->watch_events = watch_events;
+            connection->ring = -1;
+            connection->subscribed_game = 0;
+            connection->active = true;
+            connection->out_length = 0;
+            // Watched even without events, so the loop notices when the client closes its end
+            eventLoopWatch(&server_loop, fd, watch_events, i);
+            return connection;
+        }
+    }
+    fprintf(stderr, "Error: Too many connections\n");
+    return NULL;
+}
+
+// Store the client ID the connection belongs to
+void bindConnection(Connection *connection, const char *client_name)
+{
+    strncpy(connection->name, client_name, sizeof(connection->name) - 1);
+    connection->name[sizeof(connection->name) - 1] = '\0';
+}
+
+// This function is called when a client disconnects or its channel is broken. It closes the channel and drops the queued responses.
+void closeConnection(Connection *connection)
+{
+    if (connection == NULL || !connection->active)
+    {
+        return;
+    }
+    if (transport->serverClose != NULL)
+    {
+        transport->serverClose(connection);
+    }
+    unsubscribeGame(connection);
+    if (connection->response_fd >= 0)
+    {
+        eventLoopUnwatch(&server_loop, connection->response_fd);
+        close(connection->response_fd);
+    }
+    free(connection->out_buffer);
+    connection->out_buffer = NULL;
+    connection->out_length = 0;
+    connection->out_capacity = 0;
+    frameReaderFree(&connection->reader);
+    connection->response_fd = -1;
+    connection->name[0] = '\0';
+    connection->active = false;
+    connection->generation++;
+}
+
+// Write as much of the outbound queue of a client as the channel accepts.
+// When the channel is full the rest is written when the loop reports it writable. Returns false if the client is gone.
+bool flushConnection(Connection *connection)
+{
+    size_t written = 0;
+    while (written < connection->out_length)
+    {
+        ssize_t result = transport->serverWrite(connection, connection->out_buffer + written, connection->out_length - written);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            closeConnection(connection);
+            return false;
+        }
+        written += (size_t)result;
+    }
+    connection->out_length -= written;
+    memmove(connection->out_buffer, connection->out_buffer + written, connection->out_length);
+    // Only ask for write events while something is waiting
+    int events = connection->watch_events | (connection->out_length > 0 ? EVENT_WRITE : 0);
+    eventLoopWatch(&server_loop, connection->response_fd, events, (int)(connection - connections));
+    return true;
+}
+
+// Send a message to a client on its already open channel.
+// The message is put in the outbound queue of the client and written without blocking the server.
+// If the client is gone or stopped reading the connection is closed.
+bool sendFrame(Connection *connection, CommandCode command, uint32_t correlation_id, uint16_t flags, const char *payload, size_t length)
+{
+    if (connection == NULL || !connection->active)
+    {
+        return false;
+    }
+    size_t frame_length = sizeof(FrameHeader) + length;
+    if (connection->out_length + frame_length > MAX_OUTBOUND_QUEUE)
+    {
+        fprintf(stderr, "Error: %s does not read its responses\n", connection->name);
+        closeConnection(connection);
+        return false;
+    }
+    if (connection->out_length + frame_length > connection->out_capacity)
+    {
+        size_t capacity = connection->out_capacity == 0 ? BUFSIZ : connection->out_capacity;
+        while (capacity < connection->out_length + frame_length)
+        {
+            capacity *= 2;
+        }
+        char *buffer = realloc(connection->out_buffer, capacity);
+        if (buffer == NULL)
+        {
+            fprintf(stderr, "Error allocating memory\n");
+            return false;
+        }
+        connection->out_buffer = buffer;
+        connection->out_capacity = capacity;
+    }
+    bool was_empty = connection->out_length == 0;
+    connection->out_length += encodeFrame(connection->out_buffer + connection->out_length, command, correlation_id, flags, NULL, payload, length);
+    // If older messages are still waiting the loop writes this one after them
+    if (was_empty)
+    {
+        return flushConnection(connection);
+    }
+    return true;
+}
+
+// Answer a request of a client. flags tell how the payload is encoded.
+bool sendResponse(Request *request, uint16_t flags, const char *payload, size_t length)
+{
+    // A request worker does not touch the connections, the server loop sends the response
+    if (request->worker != NULL)
+    {
+        pthread_mutex_lock(&request->worker->lock);
+        bool queued = queueMessage(&request->worker->outbox, request, true, flags, payload, length);
+        pthread_mutex_unlock(&request->worker->lock);
+        return queued;
+    }
+    return sendFrame(request->connection, request->command, request->correlation_id, flags, payload, length);
+}
+
+// --------------------------------------------------------
+// -------------------- SUBSCRIPTIONS ---------------------
+// --------------------------------------------------------
+
+// A client can follow one game with "SU,<game_id>". Whenever the game changes (a player joins, makes a move or a round
+// ends) the server pushes the new state to it, so the client does not have to ask again and again.
+// The game threads only mark the game as changed and wake up the server loop, the updates are sent from the loop.
+
+// Mark a game as changed. It can be called from any thread.
+void notifyGameChanged(int game_id)
+{
+    // The changes are collected by slot, the subscribers of a slot all follow the game that is in it
+    int slot = gameSlot(game_id);
+    if (gameAtSlot(slot) == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&changed_lock);
+    bool was_empty = num_changed_games == 0;
+    if (!game_changed[slot])
+    {
+        game_changed[slot] = true;
+        changed_games[num_changed_games] = slot;
+        num_changed_games++;
+    }
+    pthread_mutex_unlock(&changed_lock);
+    // The loop is only woken once until it pushes the updates
+    if (was_empty)
+    {
+        wakeServerLoop();
+    }
+}
+
+// Wake up the server loop from another thread
+void wakeServerLoop(void)
+{
+    if (wake_fds[1] >= 0)
+    {
+        char byte = 1;
+        // If the pipe is full the loop is already going to wake up
+        if (write(wake_fds[1], &byte, 1) < 0 && errno != EAGAIN)
+        {
+            fprintf(stderr, "Error waking up the server loop\n");
+        }
+    }
+    else if (transport->serverWake != NULL && server_loop.running)
+    {
+        transport->serverWake();
+    }
+}
+
+// Encode a game update: the game ID and the changes since the version the client has.
+// buffer needs GAME_UPDATE_MAX_SIZE bytes. The version the update brings the client to is put into version.
+size_t encodeGameUpdate(int game_id, uint32_t since, uint8_t *buffer, uint32_t *version)
+{
+    size_t length = putVarint(buffer, (uint32_t)game_id);
+    return length + getGameDeltaBinary(game_id, since, buffer + length, version);
+}
+
+// Start pushing the updates of a game to the client. A client follows only one game at a time.
+bool subscribeGame(Connection *connection, int game_id)
+{
+    if (connection == NULL)
+    {
+        return false;
+    }
+    unsubscribeGame(connection);
+    // A followed game keeps its slot, so its updates can be pushed even after it finished
+    Game *followed = acquireGame(game_id);
+    if (followed == NULL)
+    {
+        return false;
+    }
+    GameSubscribers *game = &subscribers[gameSlot(game_id)];
+    if (game->count == MAX_GAME_SUBSCRIBERS)
+    {
+        releaseGame(followed);
+        return false;
+    }
+    game->connections[game->count] = connection;
+    game->count++;
+    connection->subscribed_game = game_id;
+    connection->pushed_version = 0;
+    return true;
+}
+
+void unsubscribeGame(Connection *connection)
+{
+    if (connection == NULL || connection->subscribed_game == 0)
+    {
+        return;
+    }
+    int slot = gameSlot(connection->subscribed_game);
+    GameSubscribers *game = &subscribers[slot];
+    for (int i = 0; i < game->count; i++)
+    {
+        if (game->connections[i] == connection)
+        {
+            // The order does not matter, the last one takes its place
+            game->count--;
+            game->connections[i] = game->connections[game->count];
+            break;
+        }
+    }
+    releaseGame(gameAtSlot(slot));
+    connection->subscribed_game = 0;
+}
+
+// Push the state of every changed game to its subscribers. Called by the server loop.
+void publishGameUpdates(void)
+{
+    int games_to_send[MAX_GAMES];
+    pthread_mutex_lock(&changed_lock);
+    int count = num_changed_games;
+    for (int i = 0; i < count; i++)
+    {
+        games_to_send[i] = changed_games[i];
+        game_changed[changed_games[i]] = false;
+    }
+    num_changed_games = 0;
+    pthread_mutex_unlock(&changed_lock);
+
+    for (int i = 0; i < count; i++)
+    {
+        GameSubscribers *game = &subscribers[games_to_send[i]];
+        if (game->count == 0)
+        {
+            continue;
+        }
+        int game_id = game->connections[0]->subscribed_game;
+        // Every subscriber gets the changes since the version it has. Usually they all have the same version,
+        // so the update is only encoded again for a subscriber that is behind the others.
+        uint8_t update[GAME_UPDATE_MAX_SIZE];
+        size_t length = 0;
+        uint32_t since = 0;
+        uint32_t version = 0;
+        for (int j = game->count - 1; j >= 0; j--)
+        {
+            Connection *connection = game->connections[j];
+            if (length == 0 || connection->pushed_version != since)
+            {
+                since = connection->pushed_version;
+                length = encodeGameUpdate(game_id, since, update, &version);
+            }
+            if (version == connection->pushed_version)
+            {
+                continue;
+            }
+            connection->pushed_version = version;
+            // Sending can close the connection, which removes it from the list
+            sendFrame(connection, CMD_GAME_INFO, 0, FRAME_FLAG_BINARY | FRAME_FLAG_PUSH, (const char *)update, length);
+        }
+    }
+}
+
+// --------------------------------------------------------
+// -------------------- EVENT LOOP ------------------------
+// --------------------------------------------------------
+
+#ifdef __linux__
+
+bool eventLoopInit(EventLoop *loop)
+{
+    loop->epoll_fd = epoll_create1(0);
+    loop->running = loop->epoll_fd >= 0;
+    return loop->running;
+}
+
+// Start watching a file descriptor or change the events of an already watched one.
+// Errors and hang ups are always reported, even if no events are asked.
+void eventLoopWatch(EventLoop *loop, int fd, int events, int tag)
+{
+    if (!loop->running || fd < 0)
+    {
+        return;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = ((events & EVENT_READ) ? EPOLLIN : 0) | ((events & EVENT_WRITE) ? EPOLLOUT : 0);
+    event.data.u64 = (uint64_t)(int64_t)tag;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0 && errno == ENOENT)
+    {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void eventLoopUnwatch(EventLoop *loop, int fd)
+{
+    if (loop->running)
+    {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+}
+
+// Wait until at least one watched file descriptor is ready. Returns the number of events.
+int eventLoopWait(EventLoop *loop, LoopEvent events[], int max_events, int timeout_ms)
+{
+    struct epoll_event ready[MAX_LOOP_EVENTS];
+    if (max_events > MAX_LOOP_EVENTS)
+    {
+        max_events = MAX_LOOP_EVENTS;
+    }
+    int count = epoll_wait(loop->epoll_fd, ready, max_events, timeout_ms);
+    for (int i = 0; i < count; i++)
+    {
+        events[i].tag = (int)(int64_t)ready[i].data.u64;
+        events[i].events = ((ready[i].events & EPOLLIN) ? EVENT_READ : 0) | ((ready[i].events & EPOLLOUT) ? EVENT_WRITE : 0) |
+                           ((ready[i].events & (EPOLLERR | EPOLLHUP)) ? EVENT_CLOSED : 0);
+    }
+    return count < 0 && errno == EINTR ? 0 : count;
+}
+
+#else
+
+bool eventLoopInit(EventLoop *loop)
+{
+    loop->num_fds = 0;
+    loop->running = true;
+    return true;
+}
+
+void eventLoopWatch(EventLoop *loop, int fd, int events, int tag)
+{
+    if (!loop->running || fd < 0)
+    {
+        return;
+    }
+    int index = 0;
+    while (index < loop->num_fds && loop->fds[index].fd != fd)
+    {
+        index++;
+    }
+    if (index == loop->num_fds)
+    {
+        if (loop->num_fds == MAX_CONNECTIONS + 1)
+        {
+            return;
+        }
+        loop->num_fds++;
+    }
+    loop->fds[index].fd = fd;
+    loop->fds[index].events = (short)(((events & EVENT_READ) ? POLLIN : 0) | ((events & EVENT_WRITE) ? POLLOUT : 0));
+    loop->tags[index] = tag;
+}
+
+void eventLoopUnwatch(EventLoop *loop, int fd)
+{
+    for (int i = 0; i < loop->num_fds; i++)
+    {
+        if (loop->fds[i].fd == fd)
+        {
+            loop->num_fds--;
+            loop->fds[i] = loop->fds[loop->num_fds];
+            loop->tags[i] = loop->tags[loop->num_fds];
+            return;
+        }
+    }
+}
+
+int eventLoopWait(EventLoop *loop, LoopEvent events[], int max_events, int timeout_ms)
+{
+    int result = poll(loop->fds, (nfds_t)loop->num_fds, timeout_ms);
+    int count = 0;
+    for (int i = 0; i < loop->num_fds && count < max_events && result > 0; i++)
+    {
+        short revents = loop->fds[i].revents;
+        if (revents != 0)
+        {
+            events[count].tag = loop->tags[i];
+            events[count].events = ((revents & POLLIN) ? EVENT_READ : 0) | ((revents & POLLOUT) ? EVENT_WRITE : 0) |
+                                   ((revents & (POLLERR | POLLHUP)) ? EVENT_CLOSED : 0);
+            count++;
+        }
+    }
+    return count;
+}
+
+#endif
+
+// --------------------------------------------------------
+// -------------------- TRANSPORTS ------------------------
+// --------------------------------------------------------
+
+// Every transport carries the same messages (a FrameHeader followed by the payload).
+// The FIFO transport uses one request FIFO for all clients and a response FIFO per client.
+// The socket transport uses one SOCK_SEQPACKET connection per client, which keeps message boundaries and reports disconnects immediately.
+// The shared memory transport skips the kernel: clients write into one shared request ring and read their own response ring.
+
+const Transport fifo_transport = {
+    .name = "fifo",
+    .serverListen = fifoServerListen,
+    .serverRequestsReady = fifoServerRequestsReady,
+    .serverOpen = fifoServerOpen,
+    .serverRead = NULL,
+    .serverWrite = fifoServerWrite,
+    .serverClose = fifoServerClose,
+    .serverRun = NULL,
+    .serverWake = NULL,
+    .clientConnect = fifoClientConnect,
+    .clientSend = fifoClientSend,
+    .clientReceive = fifoClientReceive,
+};
+
+const Transport socket_transport = {
+    .name = "socket",
+    .serverListen = socketServerListen,
+    .serverRequestsReady = socketServerRequestsReady,
+    .serverOpen = socketServerOpen,
+    .serverRead = socketServerRead,
+    .serverWrite = socketServerWrite,
+    .serverClose = NULL,
+    .serverRun = NULL,
+    .serverWake = NULL,
+    .clientConnect = socketClientConnect,
+    .clientSend = socketClientSend,
+    .clientReceive = socketClientReceive,
+};
+
+const Transport shm_transport = {
+    .name = "shm",
+    .serverListen = shmServerListen,
+    .serverRequestsReady = NULL,
+    .serverOpen = shmServerOpen,
+    .serverRead = NULL,
+    .serverWrite = shmServerWrite,
+    .serverClose = shmServerClose,
+    .serverRun = shmServerRun,
+    .serverWake = shmServerWake,
+    .clientConnect = shmClientConnect,
+    .clientSend = shmClientSend,
+    .clientReceive = shmClientReceive,
+};
+
+// The transport used by this process. The FIFO transport is the default.
+const Transport *transport = &fifo_transport;
+
+// Find a transport by the name given on the command line. Returns NULL if there is no such transport.
+const Transport *findTransport(const char *name)
+{
+    const Transport *transports[] = {&fifo_transport, &socket_transport, &shm_transport};
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+    {
+        if (strcmp(transports[i]->name, name) == 0)
+        {
+            return transports[i];
+        }
+    }
+    return NULL;
+}
+
+// Fill a request from a received message. Returns false if it is not a valid request.
+bool parseRequest(const FrameHeader *header, const char *payload, Request *request)
+{
+    // Print the received message
+    const char *control = header->command < CMD_COUNT ? command_table[header->command].code : "?";
+    printf("%s: %s%s%.*s\n", header->sender, control, header->length > 0 ? "," : "", (int)header->length, payload);
+    strncpy(request->client_name, header->sender, sizeof(request->client_name) - 1);
+    request->client_name[sizeof(request->client_name) - 1] = '\0';
+    request->command = (CommandCode)header->command;
+    request->correlation_id = header->correlation_id;
+    request->flags = header->flags;
+    request->args = payload;
+    request->args_length = header->length;
+    request->connection = NULL;
+    request->generation = 0;
+    request->worker = NULL;
+    if (request->client_name[0] == '\0' || header->command == CMD_NONE || header->command >= CMD_COUNT)
+    {
+        printf("Error: Invalid command format\n");
+        return false;
+    }
+    return true;
+}
+
+// This function handles every request of a batch in the order they arrived
+void dispatchBatch(Request batch[], int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        submitRequest(&batch[i]);
+    }
+}
+
+// The main request FIFO of the server
+RequestReader fifo_reader;
+
+// This function opens the main request FIFO. It stays open for the whole lifetime of the server.
+bool openRequestReader(RequestReader *reader)
+{
+    /* create the FIFO (named pipe) */
+    mkfifo(FIFO_FILE, 0666);
+    // The server keeps a write end open as well, so the FIFO never reports end of file when the last client leaves
+    reader->fd = open(FIFO_FILE, O_RDONLY | O_NONBLOCK);
+    reader->keepalive_fd = open(FIFO_FILE, O_WRONLY);
+    if (reader->fd < 0 || reader->keepalive_fd < 0)
+    {
+        fprintf(stderr, "Error opening %s\n", FIFO_FILE);
+        return false;
+    }
+    memset(&reader->frames, 0, sizeof(reader->frames));
+    return true;
+}
+
+// This function reads the request FIFO and splits the data into the separate messages of the clients.
+// Clients write back to back, so one read can contain many messages. All complete messages are returned
+// in the batch, an incomplete one at the end is kept until the rest of it arrives.
+// The FIFO is non-blocking: if nothing complete arrived yet the batch is empty.
+// The returned requests point into the reader's buffer and are valid until the next call.
+int readRequestBatch(RequestReader *reader, Request batch[], int max_batch)
+{
+    FrameHeader header;
+    const char *payload;
+    int count = 0;
+    // Only read if there is no complete message left from the previous read
+    int result = frameReaderNext(&reader->frames, &header, &payload);
+    if (result == 0)
+    {
+        char *space = frameReaderReserve(&reader->frames, BUFSIZ * 4);
+        ssize_t length = read(reader->fd, space, BUFSIZ * 4);
+        if (length < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            return -1;
+        }
+        if (length > 0)
+        {
+            frameReaderCommit(&reader->frames, (size_t)length);
+        }
+        result = frameReaderNext(&reader->frames, &header, &payload);
+    }
+    while (result == 1)
+    {
+        if (parseRequest(&header, payload, &batch[count]))
+        {
+            count++;
+        }
+        if (count == max_batch)
+        {
+            break;
+        }
+        result = frameReaderNext(&reader->frames, &header, &payload);
+    }
+    return count;
+}
+
+bool fifoServerListen(void)
+{
+    if (!openRequestReader(&fifo_reader))
+    {
+        return false;
+    }
+    eventLoopWatch(&server_loop, fifo_reader.fd, EVENT_READ, EVENT_TAG_REQUESTS);
+    return true;
+}
+
+// Handle everything that arrived at once. A full batch means there can be more in the buffer.
+void fifoServerRequestsReady(void)
+{
+    static Request batch[MAX_BATCH];
+    int count;
+    do
+    {
+        count = readRequestBatch(&fifo_reader, batch, MAX_BATCH);
+        if (count < 0)
+        {
+            fprintf(stderr, "Error reading %s\n", FIFO_FILE);
+            exit(EXIT_FAILURE);
+        }
+        dispatchBatch(batch, count);
+    } while (count == MAX_BATCH);
+}
+
+// This function is called when a client registers. It creates and opens the response FIFO of the client once,
+// the channel stays open until the client disconnects. If the client already has a channel it is reused.
+Connection *fifoServerOpen(Connection *connection, const char *client_name)
+{
+    if (connection != NULL)
+    {
+        return connection;
+    }
+    char client_fifo[BUFSIZ];
+    snprintf(client_fifo, sizeof(client_fifo), "%s_%s", FIFO_FILE_RESPONSE, client_name);
+    mkfifo(client_fifo, 0666);
+    // The client opens its end before registering. If it did not, opening fails instead of blocking the server.
+    int pipe_fd_response = open(client_fifo, O_WRONLY | O_NONBLOCK);
+    if (pipe_fd_response < 0)
+    {
+        fprintf(stderr, "Error opening response channel of %s\n", client_name);
+        return NULL;
+    }
+    connection = allocateConnection(pipe_fd_response, 0);
+    if (connection == NULL)
+    {
+        close(pipe_fd_response);
+        return NULL;
+    }
+    bindConnection(connection, client_name);
+    return connection;
+}
+
+ssize_t fifoServerWrite(Connection *connection, const char *data, size_t length)
+{
+    return write(connection->response_fd, data, length);
+}
+
+// The response FIFO of a client is removed when it disconnects
+void fifoServerClose(Connection *connection)
+{
+    char client_fifo[BUFSIZ];
+    snprintf(client_fifo, sizeof(client_fifo), "%s_%s", FIFO_FILE_RESPONSE, connection->name);
+    unlink(client_fifo);
+}
+
+// The listening socket of the server
+int listen_fd = -1;
+
+bool socketServerListen(void)
+{
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "Error creating socket\n");
+        return false;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, SOCKET_FILE, sizeof(address.sun_path) - 1);
+    unlink(SOCKET_FILE);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "Error listening on %s\n", SOCKET_FILE);
+        return false;
+    }
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    eventLoopWatch(&server_loop, listen_fd, EVENT_READ, EVENT_TAG_REQUESTS);
+    return true;
+}
+
+// Accept every waiting client. Each of them gets its own connection that is used in both directions.
+void socketServerRequestsReady(void)
+{
+    int fd;
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        if (allocateConnection(fd, EVENT_READ) == NULL)
+        {
+            close(fd);
+        }
+    }
+}
+
+// The connection already exists from the moment the client connected, registering only binds the name to it
+Connection *socketServerOpen(Connection *connection, const char *client_name)
+{
+    if (connection != NULL)
+    {
+        bindConnection(connection, client_name);
+    }
+    return connection;
+}
+
+// The packets are put together into messages and the requests are handled as they are received.
+void socketServerRead(Connection *connection)
+{
+    for (int i = 0; i < MAX_BATCH && connection->active; i++)
+    {
+        char *space = frameReaderReserve(&connection->reader, SOCKET_MAX_PACKET);
+        ssize_t result = recv(connection->response_fd, space, SOCKET_MAX_PACKET, 0);
+        if (result == 0 || (result < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            // The client disconnected
+            closeConnection(connection);
+            return;
+        }
+        if (result < 0)
+        {
+            return;
+        }
+        frameReaderCommit(&connection->reader, (size_t)result);
+        FrameHeader header;
+        const char *payload;
+        int next;
+        while ((next = frameReaderNext(&connection->reader, &header, &payload)) == 1)
+        {
+            Request request;
+            if (parseRequest(&header, payload, &request))
+            {
+                request.connection = connection;
+                submitRequest(&request);
+                if (!connection->active)
+                {
+                    return;
+                }
+            }
+        }
+        if (next < 0)
+        {
+            closeConnection(connection);
+            return;
+        }
+    }
+}
+
+// Long messages are sent in more packets, the client puts them together again
+ssize_t socketServerWrite(Connection *connection, const char *data, size_t length)
+{
+    return send(connection->response_fd, data, length < SOCKET_MAX_PACKET ? length : SOCKET_MAX_PACKET, MSG_NOSIGNAL);
+}
+
+// Shared memory segment of the shm transport, mapped by the server and every client
+ShmSegment *shm_segment = NULL;
+// Connection of every response ring, with the ring generation and the client process it belongs to
+Connection *shm_connections[SHM_MAX_CLIENTS];
+uint32_t shm_generations[SHM_MAX_CLIENTS];
+uint32_t shm_owners[SHM_MAX_CLIENTS];
+
+// Sleep while *address still holds value. Other processes wake the sleeper with futexWake().
+void futexWait(_Atomic uint32_t *address, uint32_t value, int timeout_ms)
+{
+#ifdef __linux__
+    struct timespec timeout = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L};
+    syscall(SYS_futex, (uint32_t *)address, FUTEX_WAIT, value, timeout_ms < 0 ? NULL : &timeout, NULL, 0);
+#else
+    // No futex on this system, poll the word instead
+    for (int waited = 0; atomic_load(address) == value && (timeout_ms < 0 || waited < timeout_ms * 20); waited++)
+    {
+        usleep(50);
+    }
+#endif
+}
+
+void futexWake(_Atomic uint32_t *address)
+{
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)address, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+    (void)address;
+#endif
+}
+
+void shmInitSegment(ShmSegment *segment)
+{
+    memset(segment, 0, sizeof(ShmSegment));
+    for (uint32_t i = 0; i < SHM_REQUEST_SLOTS; i++)
+    {
+        atomic_store(&segment->requests.slots[i].sequence, i);
+    }
+}
+
+// Put a request into the shared request ring. Any number of clients can push at the same time.
+// Returns false if the ring is full.
+bool shmRequestPush(ShmRequestRing *ring, uint16_t response_ring, uint32_t generation, const char *data, size_t length)
+{
+    if (length > sizeof(ring->slots[0].data))
+    {
+        return false;
+    }
+    uint32_t position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    ShmRequestSlot *slot;
+    while (true)
+    {
+        slot = &ring->slots[position & (SHM_REQUEST_SLOTS - 1)];
+        int32_t difference = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+        if (difference == 0)
+        {
+            // The slot is free, try to claim this position
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The consumer did not free this slot yet
+            return false;
+        }
+        else
+        {
+            position = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+    slot->ring = response_ring;
+    slot->generation = generation;
+    slot->length = (uint16_t)length;
+    memcpy(slot->data, data, length);
+    atomic_store(&slot->sequence, position + 1);
+    // The consumer only sleeps if the ring was empty, so only the request that made it non-empty wakes it
+    if (atomic_load(&ring->head) == position)
+    {
+        atomic_fetch_add(&ring->futex, 1);
+        futexWake(&ring->futex);
+    }
+    return true;
+}
+
+// Take the oldest request out of the ring. Only the server calls this. Returns false if the ring is empty.
+bool shmRequestPop(ShmRequestRing *ring, ShmRequestSlot *request)
+{
+    uint32_t position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ShmRequestSlot *slot = &ring->slots[position & (SHM_REQUEST_SLOTS - 1)];
+    if (atomic_load(&slot->sequence) != position + 1)
+    {
+        return false;
+    }
+    request->ring = slot->ring;
+    request->generation = slot->generation;
+    request->length = slot->length;
+    memcpy(request->data, slot->data, slot->length);
+    // Free the slot for the producers one lap later
+    atomic_store_explicit(&slot->sequence, position + SHM_REQUEST_SLOTS, memory_order_release);
+    atomic_store(&ring->head, position + 1);
+    return true;
+}
+
+// Write as much of the data as fits into a response ring. Returns the number of bytes written.
+size_t shmResponseWrite(ShmResponseRing *ring, const char *data, size_t length)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t space = SHM_RESPONSE_RING_SIZE - (tail - head);
+    if (length > space)
+    {
+        length = space;
+    }
+    size_t offset = tail & (SHM_RESPONSE_RING_SIZE - 1);
+    size_t first = length < SHM_RESPONSE_RING_SIZE - offset ? length : SHM_RESPONSE_RING_SIZE - offset;
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, length - first);
+    atomic_store(&ring->tail, tail + (uint32_t)length);
+    if (length > 0 && atomic_load(&ring->head) == tail)
+    {
+        atomic_fetch_add(&ring->futex, 1);
+        futexWake(&ring->futex);
+    }
+    return length;
+}
+
+// Read what is available in a response ring. Returns the number of bytes read, 0 if the ring is empty.
+size_t shmResponseRead(ShmResponseRing *ring, char *buffer, size_t size)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t length = tail - head;
+    if (length > size)
+    {
+        length = size;
+    }
+    size_t offset = head & (SHM_RESPONSE_RING_SIZE - 1);
+    size_t first = length < SHM_RESPONSE_RING_SIZE - offset ? length : SHM_RESPONSE_RING_SIZE - offset;
+    memcpy(buffer, ring->data + offset, first);
+    memcpy(buffer + first, ring->data, length - first);
+    atomic_store(&ring->head, head + (uint32_t)length);
+    return length;
+}
+
+// Map the shared memory segment. The server creates it, clients open the existing one.
+ShmSegment *shmMap(bool create)
+{
+    int fd = shm_open(SHM_FILE, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0666);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (create && ftruncate(fd, sizeof(ShmSegment)) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    void *address = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return address == MAP_FAILED ? NULL : address;
+}
+
+bool shmServerListen(void)
+{
+    shm_segment = shmMap(true);
+    if (shm_segment == NULL)
+    {
+        fprintf(stderr, "Error creating shared memory %s\n", SHM_FILE);
+        return false;
+    }
+    shmInitSegment(shm_segment);
+    atomic_store(&shm_segment->server_pid, (uint32_t)getpid());
+    return true;
+}
+
+// The loop of the server with the shared memory transport. It takes the requests out of the ring
+// and sleeps on the ring's futex when there is nothing to do.
+void shmServerRun(void)
+{
+    ShmRequestSlot request;
+    while (true)
+    {
+        int handled = 0;
+        uint32_t futex = atomic_load(&shm_segment->requests.futex);
+        while (handled < MAX_BATCH && shmRequestPop(&shm_segment->requests, &request))
+        {
+            handled++;
+            if (request.ring >= SHM_MAX_CLIENTS)
+            {
+                continue;
+            }
+            // A ring claimed by a new client starts a new connection
+            Connection *connection = shm_connections[request.ring];
+            if (connection != NULL && shm_generations[request.ring] != request.generation)
+            {
+                closeConnection(connection);
+                connection = NULL;
+            }
+            if (connection == NULL)
+            {
+                connection = allocateConnection(-1, 0);
+                if (connection == NULL)
+                {
+                    continue;
+                }
+                connection->ring = request.ring;
+                shm_connections[request.ring] = connection;
+                shm_generations[request.ring] = request.generation;
+                shm_owners[request.ring] = atomic_load(&shm_segment->responses[request.ring].owner);
+            }
+            // Every slot holds exactly one message
+            FrameHeader header;
+            const char *payload;
+            Request parsed;
+            if (decodeFrame(request.data, request.length, &header, &payload) && parseRequest(&header, payload, &parsed))
+            {
+                parsed.connection = connection;
+                submitRequest(&parsed);
+            }
+        }
+        expireTimers(timerNow());
+        drainRequestOutboxes();
+        publishGameUpdates();
+        // Write the responses that did not fit into a full ring before
+        bool pending = false;
+        for (int i = 0; i < SHM_MAX_CLIENTS; i++)
+        {
+            if (shm_connections[i] != NULL && shm_connections[i]->out_length > 0)
+            {
+                flushConnection(shm_connections[i]);
+                pending = pending || (shm_connections[i] != NULL && shm_connections[i]->out_length > 0);
+            }
+        }
+        if (handled == 0)
+        {
+            int timeout = timerTimeout();
+            if (pending && (timeout < 0 || timeout > 1))
+            {
+                timeout = 1;
+            }
+            futexWait(&shm_segment->requests.futex, futex, timeout);
+        }
+    }
+}
+
+// The loop sleeps on the futex of the request ring, a changed futex word wakes it up as a new request would
+void shmServerWake(void)
+{
+    atomic_fetch_add(&shm_segment->requests.futex, 1);
+    futexWake(&shm_segment->requests.futex);
+}
+
+// The ring was already chosen by the client, registering only binds the name to it
+Connection *shmServerOpen(Connection *connection, const char *client_name)
+{
+    if (connection != NULL)
+    {
+        bindConnection(connection, client_name);
+    }
+    return connection;
+}
+
+ssize_t shmServerWrite(Connection *connection, const char *data, size_t length)
+{
+    size_t written = shmResponseWrite(&shm_segment->responses[connection->ring], data, length);
+    if (written == 0 && length > 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    return (ssize_t)written;
+}
+
+// The ring is given back, so another client can claim it. If a new client already took it over nothing changes.
+void shmServerClose(Connection *connection)
+{
+    if (connection->ring >= 0)
+    {
+        uint32_t owner = shm_owners[connection->ring];
+        atomic_compare_exchange_strong(&shm_segment->responses[connection->ring].owner, &owner, 0);
+        shm_connections[connection->ring] = NULL;
+        connection->ring = -1;
+    }
+}
+
+// Send a list of game IDs in the binary encoding
+void sendGameList(Request *request, const int game_ids[], int count)
+{
+    StringBuilder list = {NULL, 0, 0};
+    if (encodeGameList(&list, game_ids, count))
+    {
+        sendResponse(request, FRAME_FLAG_BINARY, list.data, list.length);
+    }
+    free(list.data);
+}
+
+// --------------------------------------------------------
+// ---------------------- COMMANDS ------------------------
+// --------------------------------------------------------
+
+// Every command has an entry in command_table: its control code, the arguments it takes and its handler.
+// The arguments are parsed in place and checked before the handler is called, so the handlers get typed values.
+
+// Take the next token of rest up to the separator and move rest after it. Nothing is copied or modified.
+// Returns false if rest is empty.
+bool nextToken(Span *rest, char separator, Span *token)
+{
+    if (rest->length == 0)
+    {
+        return false;
+    }
+    const char *end = memchr(rest->data, separator, rest->length);
+    size_t length = end != NULL ? (size_t)(end - rest->data) : rest->length;
+    token->data = rest->data;
+    token->length = length;
+    rest->data += length;
+    rest->length -= length;
+    if (end != NULL)
+    {
+        // Skip the separator
+        rest->data++;
+        rest->length--;
+    }
+    return true;
+}
+
+// Parse a decimal number between min and max. Returns false if the token is not one.
+bool spanToInt(Span token, long min, long max, long *value)
+{
+    // 18 digits always fit into a long
+    if (token.length == 0 || token.length > 18)
+    {
+        return false;
+    }
+    long result = 0;
+    for (size_t i = 0; i < token.length; i++)
+    {
+        if (!isdigit((unsigned char)token.data[i]))
+        {
+            return false;
+        }
+        result = result * 10 + (token.data[i] - '0');
+    }
+    if (result < min || result > max)
+    {
+        return false;
+    }
+    *value = result;
+    return true;
+}
+
+// Parse and check the arguments of a command. Returns false if they do not match what the command takes.
+bool parseArguments(ArgumentKind kind, Span rest, CommandArgs *args)
+{
+    Span token;
+    long value;
+    memset(args, 0, sizeof(*args));
+    if (kind == ARGS_NONE)
+    {
+        return true;
+    }
+    // Every other kind starts with a number
+    if (!nextToken(&rest, ',', &token))
+    {
+        return false;
+    }
+    switch (kind)
+    {
+    case ARGS_NEW_GAME:
+        if (!spanToInt(token, 2, MAX_GAME_PLAYERS, &value))
+        {
+            return false;
+        }
+        args->num_players = (int)value;
+        if (!nextToken(&rest, ',', &token) || !spanToInt(token, 1, MAX_GAME_ROUNDS, &value))
+        {
+            return false;
+        }
+        args->num_rounds = (int)value;
+        return true;
+    case ARGS_TOP:
+        if (!spanToInt(token, 1, MAX_LEADERBOARD_TOP, &value))
+        {
+            return false;
+        }
+        args->top = (int)value;
+        return true;
+    case ARGS_PAGE:
+        if (!spanToInt(token, 1, INT_MAX, &value))
+        {
+            return false;
+        }
+        args->page = (int)value;
+        if (!nextToken(&rest, ',', &token) || !spanToInt(token, 1, MAX_LEADERBOARD_PAGE, &value))
+        {
+            return false;
+        }
+        args->page_size = (int)value;
+        return true;
+    case ARGS_RANK:
+        if (!spanToInt(token, 0, (MAX_LEADERBOARD_PAGE - 1) / 2, &value))
+        {
+            return false;
+        }
+        args->around = (int)value;
+        // Without a name the client asks for its own place
+        if (nextToken(&rest, ',', &token))
+        {
+            if (token.length == 0 || token.length > PLAYER_ID_WIDTH)
+            {
+                return false;
+            }
+            memcpy(args->player, token.data, token.length);
+            args->player[token.length] = '\0';
+        }
+        return true;
+    case ARGS_LOBBY:
+        if (!spanToInt(token, 1, MAX_LOBBY_PAGE, &value))
+        {
+            return false;
+        }
+        args->lobby.count = (int)value;
+        if (!nextToken(&rest, ',', &token) || token.length != 1 || (token.data[0] != LOBBY_BY_AGE && token.data[0] != LOBBY_BY_FILL))
+        {
+            return false;
+        }
+        args->lobby.sort = (LobbySort)token.data[0];
+        if (!nextToken(&rest, ',', &token) || !spanToInt(token, 0, LONG_MAX, &value))
+        {
+            return false;
+        }
+        args->lobby.cursor = (uint64_t)value;
+        // The filters are optional, but they come together
+        if (!nextToken(&rest, ',', &token))
+        {
+            return true;
+        }
+        if (!spanToInt(token, 0, MAX_GAME_PLAYERS, &value))
+        {
+            return false;
+        }
+        args->lobby.num_players = (int)value;
+        if (!nextToken(&rest, ',', &token) || !spanToInt(token, 0, MAX_GAME_ROUNDS, &value))
+        {
+            return false;
+        }
+        args->lobby.num_rounds = (int)value;
+        if (!nextToken(&rest, ',', &token) || !spanToInt(token, 0, MAX_GAME_PLAYERS, &value))
+        {
+            return false;
+        }
+        args->lobby.min_free = (int)value;
+        return true;
+    case ARGS_GAME:
+    case ARGS_DECISION:
+    case ARGS_GAME_VERSION:
+        if (!spanToInt(token, 1, INT_MAX, &value))
+        {
+            return false;
+        }
+        args->game_id = (int)value;
+        if (kind == ARGS_GAME)
+        {
+            return true;
+        }
+        if (!nextToken(&rest, ',', &token))
+        {
+            return false;
+        }
+        if (kind == ARGS_DECISION)
+        {
+            args->decision = token.length == 1 ? token.data[0] : '\0';
+            return moveCode(args->decision) != MOVE_NONE;
+        }
+        if (!spanToInt(token, 0, UINT32_MAX, &value))
+        {
+            return false;
+        }
+        args->version = (uint32_t)value;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// This is for when a new client wants to register
+void handleRegister(Request *request, const CommandArgs *args)
+{
+    // Check if the name is already taken
+    bool registered = registerClient(request->client_name);
+    // Send a message to the client if the registration was successful or not
+    const char *message = registered ? "registered" : "notregistered";
+
+    // Open the response channel of the client. It is kept open for the whole session.
+    Connection *connection = request->connection;
+    bool connected = connection != NULL;
+    if (registered || !connected)
+    {
+        connection = transport->serverOpen(connection, request->client_name);
+    }
+    // The answer tells the client if the server speaks the binary encoding it asked for
+    sendFrame(connection, request->command, request->correlation_id, request->flags & FRAME_FLAG_BINARY, message, strlen(message));
+    // A rejected client quits, so its channel is not kept
+    if (!registered && !connected)
+    {
+        closeConnection(connection);
+    }
+}
+
+// This is for when a client quits, its response channel is closed
+void handleQuit(Request *request, const CommandArgs *args)
+{
+    closeConnection(request->connection);
+}
+
+// This is for when a client wants to get the leaderboard
+void handleLeaderboard(Request *request, const CommandArgs *args)
+{
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        StringBuilder leaderboard = {NULL, 0, 0};
+        if (encodeLeaderBoard(&leaderboard))
+        {
+            sendResponse(request, FRAME_FLAG_BINARY, leaderboard.data, leaderboard.length);
+        }
+        free(leaderboard.data);
+        return;
+    }
+    // Get the leaderboard string and send it to the client
+    char *players_string = getLeaderBoard();
+    sendResponse(request, 0, players_string, strlen(players_string));
+    free(players_string);
+}
+
+// The top of the leaderboard and the place of the client. The answer has the same size for any number of players.
+// Text format: <num_ranked>;<my_rank>,<my_score>,<my_matches>;<player>,<score>,<matches>;...
+void handleLeaderboardTop(Request *request, const CommandArgs *args)
+{
+    LeaderBoardTop top;
+    getLeaderBoardTop(request->client_name, args->top, &top);
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        uint8_t buffer[LEADERBOARD_TOP_MAX_SIZE];
+        size_t length = encodeLeaderBoardTop(&top, buffer);
+        sendResponse(request, FRAME_FLAG_BINARY, (const char *)buffer, length);
+        return;
+    }
+    StringBuilder text = {NULL, 0, 0};
+    bool success = builderPrintf(&text, "%d;%d,%d,%d;", top.num_ranked, top.my_rank, top.me.score, top.me.matches);
+    for (int i = 0; i < top.count && success; i++)
+    {
+        success = builderPrintf(&text, "%s,%d,%d;", top.top[i].name, top.top[i].score, top.top[i].matches);
+    }
+    if (success)
+    {
+        sendResponse(request, 0, text.data, text.length);
+    }
+    free(text.data);
+}
+
+// Send a page of the leaderboard. Text format: <num_ranked>,<first_rank>,<my_rank>;<player>,<score>,<matches>;...
+void sendLeaderBoardPage(Request *request, const LeaderBoardPage *page)
+{
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        uint8_t buffer[LEADERBOARD_PAGE_MAX_SIZE];
+        size_t length = encodeLeaderBoardPage(page, buffer);
+        sendResponse(request, FRAME_FLAG_BINARY, (const char *)buffer, length);
+        return;
+    }
+    StringBuilder text = {NULL, 0, 0};
+    bool success = builderPrintf(&text, "%d,%d,%d;", page->num_ranked, page->first_rank, page->my_rank);
+    for (int i = 0; i < page->count && success; i++)
+    {
+        success = builderPrintf(&text, "%s,%d,%d;", page->players[i].name, page->players[i].score, page->players[i].matches);
+    }
+    if (success)
+    {
+        sendResponse(request, 0, text.data, text.length);
+    }
+    free(text.data);
+}
+
+// Page <page> (from 1) of the leaderboard with <size> players on a page
+void handleLeaderboardPage(Request *request, const CommandArgs *args)
+{
+    LeaderBoardPage page;
+    getLeaderBoardPage((long)(args->page - 1) * args->page_size, args->page_size, &page);
+    sendLeaderBoardPage(request, &page);
+}
+
+// The place of a player (the client if no name is given) and the players around it
+void handleLeaderboardRank(Request *request, const CommandArgs *args)
+{
+    LeaderBoardPage page;
+    getLeaderBoardAround(args->player[0] != '\0' ? args->player : request->client_name, args->around, &page);
+    sendLeaderBoardPage(request, &page);
+}
+
+// Number of players on the leaderboard
+void handleLeaderboardCount(Request *request, const CommandArgs *args)
+{
+    int count = leaderBoardCount();
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        uint8_t buffer[5];
+        sendResponse(request, FRAME_FLAG_BINARY, (const char *)buffer, putVarint(buffer, (uint32_t)count));
+        return;
+    }
+    char text[16];
+    snprintf(text, sizeof(text), "%d", count);
+    sendResponse(request, 0, text, strlen(text));
+}
+
+// A page of the waiting rooms the client can join, filtered and in the asked order.
+// Text format: <next_cursor>;<game_id>,<num_joined>,<num_players>,<num_rounds>;...
+void handleLobbyQuery(Request *request, const CommandArgs *args)
+{
+    LobbyPage page;
+    queryLobby(request->client_name, &args->lobby, &page);
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        uint8_t buffer[LOBBY_PAGE_MAX_SIZE];
+        size_t length = encodeLobbyPage(&page, buffer);
+        sendResponse(request, FRAME_FLAG_BINARY, (const char *)buffer, length);
+        return;
+    }
+    StringBuilder text = {NULL, 0, 0};
+    bool success = builderPrintf(&text, "%llu;", (unsigned long long)page.next_cursor);
+    for (int i = 0; i < page.count && success; i++)
+    {
+        success = builderPrintf(&text, "%d,%d,%d,%d;", page.rooms[i].game_id, page.rooms[i].num_joined,
+                                page.rooms[i].num_players, page.rooms[i].num_rounds);
+    }
+    if (success)
+    {
+        sendResponse(request, 0, text.data, text.length);
+    }
+    free(text.data);
+}
+
+// This is for when a client wants to create a new game
+void handleNewGame(Request *request, const CommandArgs *args)
+{
+    createNewGameServer(args->num_players, args->num_rounds);
+}
+
+// This is for when a client wants to list the waiting games
+void handleWaitingGames(Request *request, const CommandArgs *args)
+{
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        int game_ids[MAX_GAMES];
+        sendGameList(request, game_ids, findWaitingGames(request->client_name, game_ids));
+        return;
+    }
+    char *games_string = listWaitingGames(request->client_name);
+    sendResponse(request, 0, games_string, strlen(games_string));
+    free(games_string);
+}
+
+// This is for when a client wants to join a game
+void handleJoinGame(Request *request, const CommandArgs *args)
+{
+    // Check if it is possible to join the game
+    // Send a message to the client if the join was successful or not
+    const char *response = joinGame(args->game_id, request->client_name) ? "joined" : "notjoined";
+    sendResponse(request, 0, response, strlen(response));
+}
+
+// This is for when a client wants to get the list of games that he is joined
+void handleCurrentGames(Request *request, const CommandArgs *args)
+{
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        int game_ids[MAX_GAMES];
+        sendGameList(request, game_ids, findPlayerGames(request->client_name, game_ids));
+        return;
+    }
+    char *games_string = listGames(request->client_name);
+    sendResponse(request, 0, games_string, strlen(games_string));
+    free(games_string);
+}
+
+// This is for when a client wants to get the information about a game
+void handleGameInfo(Request *request, const CommandArgs *args)
+{
+    if (request->flags & FRAME_FLAG_BINARY)
+    {
+        // Encoded straight into a buffer on the stack
+        uint8_t game_info[GAME_INFO_MAX_SIZE];
+        size_t length = getGameInfoBinary(args->game_id, game_info);
+        sendResponse(request, FRAME_FLAG_BINARY, (const char *)game_info, length);
+        return;
+    }
+    // Get the game info string and send it to the client
+    // If the game not started yet it is "notstarted" instead of the game info string
+    char *game_info = getGameInfo(args->game_id);
+    sendResponse(request, 0, game_info, strlen(game_info));
+    free(game_info);
+}
+
+// This is for when a client wants to make a decision
+void handleMakeDecision(Request *request, const CommandArgs *args)
+{
+    makeMove(args->game_id, args->decision, request->client_name);
+}
+
+// This is for when a client opens a game. The answer is the current state, the changes are pushed after it.
+// Game updates are always binary encoded.
+void handleSubscribe(Request *request, const CommandArgs *args)
+{
+    if (!subscribeGame(request->connection, args->game_id))
+    {
+        printf("Error: Cannot subscribe to game %d\n", args->game_id);
+        sendResponse(request, 0, "notsubscribed", strlen("notsubscribed"));
+        return;
+    }
+    // The client has nothing yet, so the answer is the full game
+    uint8_t update[GAME_UPDATE_MAX_SIZE];
+    size_t length = encodeGameUpdate(args->game_id, 0, update, &request->connection->pushed_version);
+    sendResponse(request, FRAME_FLAG_BINARY, (const char *)update, length);
+}
+
+// This is for when a client leaves a game
+void handleUnsubscribe(Request *request, const CommandArgs *args)
+{
+    unsubscribeGame(request->connection);
+}
+
+// This is for when a client wants the changes of a game since the version it has. Deltas are always binary encoded.
+void handleGameDelta(Request *request, const CommandArgs *args)
+{
+    uint8_t delta[GAME_DELTA_MAX_SIZE];
+    uint32_t version;
+    size_t length = getGameDeltaBinary(args->game_id, args->version, delta, &version);
+    sendResponse(request, FRAME_FLAG_BINARY, (const char *)delta, length);
+}
+
+// The commands indexed by their CommandCode
+const CommandSpec command_table[CMD_COUNT] = {
+    [CMD_NONE] = {"", ARGS_NONE, NULL},
+    [CMD_REGISTER] = {"C", ARGS_NONE, handleRegister, true},
+    [CMD_QUIT] = {"Q", ARGS_NONE, handleQuit, true},
+    [CMD_LEADERBOARD] = {"4L", ARGS_NONE, handleLeaderboard},
+    [CMD_NEW_GAME] = {"NG", ARGS_NEW_GAME, handleNewGame},
+    [CMD_WAITING_GAMES] = {"SW", ARGS_NONE, handleWaitingGames},
+    [CMD_JOIN_GAME] = {"JG", ARGS_GAME, handleJoinGame},
+    [CMD_CURRENT_GAMES] = {"SG", ARGS_NONE, handleCurrentGames},
+    [CMD_GAME_INFO] = {"GI", ARGS_GAME, handleGameInfo},
+    [CMD_MAKE_DECISION] = {"MD", ARGS_DECISION, handleMakeDecision},
+    [CMD_SUBSCRIBE] = {"SU", ARGS_GAME, handleSubscribe, true},
+    [CMD_UNSUBSCRIBE] = {"US", ARGS_NONE, handleUnsubscribe, true},
+    [CMD_GAME_DELTA] = {"GD", ARGS_GAME_VERSION, handleGameDelta},
+    [CMD_LEADERBOARD_TOP] = {"LT", ARGS_TOP, handleLeaderboardTop},
+    [CMD_LEADERBOARD_PAGE] = {"LP", ARGS_PAGE, handleLeaderboardPage},
+    [CMD_LEADERBOARD_RANK] = {"LR", ARGS_RANK, handleLeaderboardRank},
+    [CMD_LEADERBOARD_COUNT] = {"LC", ARGS_NONE, handleLeaderboardCount},
+    [CMD_LOBBY_QUERY] = {"LQ", ARGS_LOBBY, handleLobbyQuery},
+};
+
+// This function executes one request of a client and sends the response
+void handleRequest(Request *request)
+{
+    // parseRequest() only lets through the known commands
+    const CommandSpec *command = &command_table[request->command];
+    // A request worker sends the commands that change the connections back to the server loop, after its earlier responses
+    if (request->worker != NULL && command->on_loop)
+    {
+        pthread_mutex_lock(&request->worker->lock);
+        queueMessage(&request->worker->outbox, request, false, 0, request->args, request->args_length);
+        pthread_mutex_unlock(&request->worker->lock);
+        return;
+    }
+    // Requests from the shared FIFO are matched to the client's channel by name
+    if (request->connection == NULL && request->worker == NULL)
+    {
+        request->connection = findConnection(request->client_name);
+    }
+    CommandArgs args;
+    Span rest = {request->args, request->args_length};
+    if (command->handler == NULL || !parseArguments(command->arguments, rest, &args))
+    {
+        printf("Error: Invalid command format\n");
+        return;
+    }
+    command->handler(request, &args);
+}
+
+// --------------------------------------------------------
+// ------------------- REQUEST WORKERS --------------------
+// --------------------------------------------------------
+
+// The server loop reads and decodes the messages. With request workers it does not run the requests itself,
+// it puts each of them into the queue of a worker chosen by the client ID, so the requests of a client are
+// run one after the other by the same worker. The workers never touch the connections: the responses and the
+// commands that open, close or subscribe connections go back to the server loop through the worker's outbox.
+
+// Hash of a client ID (FNV-1a), it chooses the request worker of the client
+unsigned int clientHash(const char *client_name)
+{
+    unsigned int hash = 2166136261u;
+    for (const char *c = client_name; *c != '\0'; c++)
+    {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return hash;
+}
+
+// Append a message and its data to a queue. Every message starts at a multiple of 8 bytes.
+bool queueMessage(StringBuilder *queue, const Request *request, bool response, uint16_t flags, const char *data, size_t length)
+{
+    static const char padding[8];
+    QueuedMessage message;
+    memset(&message, 0, sizeof(message));
+    message.request = *request;
+    message.request.args = NULL;
+    message.request.worker = NULL;
+    message.response = response;
+    message.flags = flags;
+    message.length = length;
+    return builderAppend(queue, (const char *)&message, sizeof(message)) &&
+           builderAppend(queue, data != NULL ? data : "", length) &&
+           builderAppend(queue, padding, (8 - length % 8) % 8);
+}
+
+// Take the message at offset out of a queue and move offset to the next one. Returns NULL at the end of the queue.
+const QueuedMessage *nextQueuedMessage(const StringBuilder *queue, size_t *offset, const char **data)
+{
+    if (*offset >= queue->length)
+    {
+        return NULL;
+    }
+    const QueuedMessage *message = (const QueuedMessage *)(queue->data + *offset);
+    *data = queue->data + *offset + sizeof(QueuedMessage);
+    *offset += sizeof(QueuedMessage) + message->length + (8 - message->length % 8) % 8;
+    return message;
+}
+
+// Run a decoded request. Without request workers it runs right away on the server loop.
+void submitRequest(Request *request)
+{
+    if (request_stage.num_workers == 0)
+    {
+        handleRequest(request);
+        return;
+    }
+    // The connection is looked up on the server loop, the workers only carry it
+    if (request->connection == NULL)
+    {
+        request->connection = findConnection(request->client_name);
+    }
+    request->generation = request->connection != NULL ? request->connection->generation : 0;
+    RequestWorker *worker = &request_stage.workers[clientHash(request->client_name) % (unsigned int)request_stage.num_workers];
+    pthread_mutex_lock(&worker->lock);
+    // The arguments point into the reader's buffer, so they are copied into the queue
+    if (queueMessage(&worker->incoming, request, false, 0, request->args, request->args_length) && worker->sleeping)
+    {
+        pthread_cond_signal(&worker->ready);
+    }
+    pthread_mutex_unlock(&worker->lock);
+}
+
+// The loop of one request worker. It takes all queued requests at once and runs them in order.
+void *requestWorker(void *arg)
+{
+    RequestWorker *worker = arg;
+    StringBuilder batch = {NULL, 0, 0};
+    pthread_mutex_lock(&worker->lock);
+    while (true)
+    {
+        while (worker->incoming.length == 0 && !worker->stopping)
+        {
+            worker->sleeping = true;
+            pthread_cond_wait(&worker->ready, &worker->lock);
+            worker->sleeping = false;
+        }
+        if (worker->incoming.length == 0)
+        {
+            // Stopping and nothing left to do
+            break;
+        }
+        // The buffers are swapped, so the server loop can queue new requests while these run
+        StringBuilder taken = worker->incoming;
+        worker->incoming = batch;
+        worker->incoming.length = 0;
+        batch = taken;
+        pthread_mutex_unlock(&worker->lock);
+
+        size_t offset = 0;
+        const char *args;
+        const QueuedMessage *message;
+        unsigned long count = 0;
+        while ((message = nextQueuedMessage(&batch, &offset, &args)) != NULL)
+        {
+            Request request = message->request;
+            request.args = args;
+            request.worker = worker;
+            handleRequest(&request);
+            count++;
+        }
+        atomic_fetch_add(&request_stage.handled, count);
+
+        pthread_mutex_lock(&worker->lock);
+        // The server loop sends the responses
+        if (worker->outbox.length > 0)
+        {
+            wakeServerLoop();
+        }
+    }
+    pthread_mutex_unlock(&worker->lock);
+    free(batch.data);
+    return NULL;
+}
+
+// Start the request workers. With 0 workers the server loop runs the requests.
+bool startRequestWorkers(int count)
+{
+    if (count > MAX_THREADS)
+    {
+        count = MAX_THREADS;
+    }
+    atomic_store(&request_stage.handled, 0);
+    for (int i = 0; i < count; i++)
+    {
+        RequestWorker *worker = &request_stage.workers[i];
+        memset(worker, 0, sizeof(*worker));
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->ready, NULL);
+        if (pthread_create(&worker->thread, NULL, requestWorker, worker))
+        {
+            fprintf(stderr, "Error creating thread\n");
+            stopRequestWorkers();
+            return false;
+        }
+        request_stage.num_workers++;
+    }
+    return true;
+}
+
+// Stop the request workers after they ran the queued requests. Their last responses are sent before they are freed.
+void stopRequestWorkers(void)
+{
+    for (int i = 0; i < request_stage.num_workers; i++)
+    {
+        RequestWorker *worker = &request_stage.workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->stopping = true;
+        pthread_cond_signal(&worker->ready);
+        pthread_mutex_unlock(&worker->lock);
+    }
+    for (int i = 0; i < request_stage.num_workers; i++)
+    {
+        pthread_join(request_stage.workers[i].thread, NULL);
+    }
+    drainRequestOutboxes();
+    for (int i = 0; i < request_stage.num_workers; i++)
+    {
+        RequestWorker *worker = &request_stage.workers[i];
+        free(worker->incoming.data);
+        free(worker->outbox.data);
+        pthread_mutex_destroy(&worker->lock);
+        pthread_cond_destroy(&worker->ready);
+    }
+    request_stage.num_workers = 0;
+}
+
+// Send the responses of the request workers and run the commands they gave back. Called by the server loop.
+void drainRequestOutboxes(void)
+{
+    static StringBuilder messages = {NULL, 0, 0};
+    for (int i = 0; i < request_stage.num_workers; i++)
+    {
+        RequestWorker *worker = &request_stage.workers[i];
+        pthread_mutex_lock(&worker->lock);
+        StringBuilder taken = worker->outbox;
+        worker->outbox = messages;
+        worker->outbox.length = 0;
+        messages = taken;
+        pthread_mutex_unlock(&worker->lock);
+
+        size_t offset = 0;
+        const char *data;
+        const QueuedMessage *message;
+        while ((message = nextQueuedMessage(&messages, &offset, &data)) != NULL)
+        {
+            Request request = message->request;
+            request.args = data;
+            Connection *connection = request.connection;
+            // The client disconnected after sending the request
+            if (connection != NULL && (!connection->active || connection->generation != request.generation))
+            {
+                continue;
+            }
+            if (!message->response)
+            {
+                handleRequest(&request);
+            }
+            else
+            {
+                // A client of the FIFO transport can get its channel after the request was queued
+                if (connection == NULL)
+                {
+                    connection = findConnection(request.client_name);
+                }
+                sendFrame(connection, request.command, request.correlation_id, message->flags, data, message->length);
+            }
+        }
+    }
+}
+
+// This function initializes the server
+void server(void)
+{
+    // Create all necessary data for the server to start
+    setupForThreads();
+    if (!startWorkers(num_game_workers < 0 ? defaultWorkerCount() : num_game_workers))
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    if (!eventLoopInit(&server_loop))
+    {
+        fprintf(stderr, "Error creating the event loop\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!transport->serverListen())
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Server ON.\n");
+
+    signal(SIGTERM, handle_server_sigterm); // Register the SIGTERM signal handler
+    signal(SIGINT, handle_server_sigint);   // Register the SIGINT signal handler
+    signal(SIGPIPE, SIG_IGN);               // A client that quits must not kill the server, it is handled when writing
 
-                // Create a unique FIFO for the client
-                char client_fifo[BUFSIZ];
-                snprintf(client_fifo, sizeof(client_fifo), "/tmp/my_fifo_response_%s", client_name);
-                mkfifo(client_fifo, 0666);
-                int pipe_fd_response = open(client_fifo, O_WRONLY);
-                write(pipe_fd_response, message, strlen(message) + 1);
-                close(pipe_fd_response);
-            }
-            if (strcmp(command, "4L") == 0)
-            {
-                // This is for when a client wants to get the leaderboard
+    if (!startRequestWorkers(num_request_workers))
+    {
+        exit(EXIT_FAILURE);
+    }
 
-                // Get the leaderboard string and send it to the client
-                char *players_string = getLeaderBoard();
+    if (transport->serverRun != NULL)
+    {
+        transport->serverRun();
+        return;
+    }
 
-                // Create a unique FIFO for the client
-                char client_fifo[BUFSIZ];
-                snprintf(client_fifo, sizeof(client_fifo), "/tmp/my_fifo_response_%s", client_name);
-                mkfifo(client_fifo, 0666);
+    // The game and request workers wake up the loop with this pipe when a game changes or responses are ready
+    if (pipe(wake_fds) < 0)
+    {
+        fprintf(stderr, "Error creating the wake up pipe\n");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+    eventLoopWatch(&server_loop, wake_fds[0], EVENT_READ, EVENT_TAG_WAKE);
 
-                int pipe_fd_response = open(client_fifo, O_WRONLY);
-                write(pipe_fd_response, players_string, strlen(players_string) + 1);
-                close(pipe_fd_response);
-                free(players_string);
-                players_string = NULL;
+    LoopEvent events[MAX_LOOP_EVENTS];
+    while (true)
+    {
+        // Wait until there are new requests, a waiting response can be written or a deadline expires
+        int num_events = eventLoopWait(&server_loop, events, MAX_LOOP_EVENTS, timerTimeout());
+        if (num_events < 0)
+        {
+            fprintf(stderr, "Error waiting for events\n");
+            exit(EXIT_FAILURE);
+        }
+        expireTimers(timerNow());
+        for (int i = 0; i < num_events; i++)
+        {
+            if (events[i].tag == EVENT_TAG_REQUESTS)
+            {
+                transport->serverRequestsReady();
+                continue;
             }
-            if (strncmp(command, "NG", 2) == 0)
+            if (events[i].tag == EVENT_TAG_WAKE)
             {
-                // This is for when a client wants to create a new game
-                char *command_copy = strdup(command);
-                char *token = strtok_r(command_copy, ",", &saveptr1);
-
-                if (token && strncmp(token, "NG", 2) == 0)
+                char buffer[64];
+                while (read(wake_fds[0], buffer, sizeof(buffer)) > 0)
                 {
-                    char *num_players_string = strtok_r(NULL, ",", &saveptr1);
-                    char *num_rounds_string = strtok_r(NULL, ",", &saveptr1);
-                    if (num_players_string == NULL || num_rounds_string == NULL)
-                    {
-                        printf("Error: Invalid command format\n");
-                        continue;
-                    }
-                    int players_num = atoi(num_players_string);
-                    int num_rounds = atoi(num_rounds_string);
-                    createNewGameServer(players_num, num_rounds);
                 }
-                free(command_copy);
-                command_copy = NULL;
-            }
-            if (strcmp(command, "SW") == 0)
-            {
-                // This is for when a client wants to list the waiting games
-                char *games_string = listWaitingGames(client_name);
-
-                char client_fifo[BUFSIZ];
-                snprintf(client_fifo, sizeof(client_fifo), "/tmp/my_fifo_response_%s", client_name);
-                mkfifo(client_fifo, 0666);
-                int pipe_fd_response = open(client_fifo, O_WRONLY);
-                write(pipe_fd_response, games_string, strlen(games_string) + 1);
-                close(pipe_fd_response);
-                free(games_string);
-                games_string = NULL;
+                drainRequestOutboxes();
+                publishGameUpdates();
+                continue;
             }
-            if (strncmp(command, "JG", 2) == 0)
+            Connection *connection = &connections[events[i].tag];
+            if (!connection->active)
             {
-                // This is for when a client wants to join a game
-                char *command_copy = strdup(command);
-                char *token = strtok_r(command_copy, ",", &saveptr1);
-
-                if (token && strncmp(token, "JG", 2) == 0)
-                {
-                    char *game_id_string = strtok_r(NULL, ",", &saveptr1);
-                    char response[BUFSIZ];
-                    response[0] = '\0';
-                    // Check if it is possible to join the game
-                    // Send a message to the client if the join was successful or not
-                    if (joinGame(atoi(game_id_string), client_name))
-                    {
-                        strcat(response, "joined");
-                    }
-                    else
-                    {
-                        strcat(response, "notjoined");
-                    }
-
-                    char client_fifo[BUFSIZ];
-                    snprintf(client_fifo, sizeof(client_fifo), "/tmp/my_fifo_response_%s", client_name);
-                    mkfifo(client_fifo, 0666);
-                    int pipe_fd_response = open(client_fifo, O_WRONLY);
-                    write(pipe_fd_response, response, strlen(response) + 1);
-                    close(pipe_fd_response);
-                }
-                free(command_copy);
-                command_copy = NULL;
+                // Closed by an earlier event of this iteration
+                continue;
             }
-            if (strcmp(command, "SG") == 0)
+            if (events[i].events & EVENT_WRITE)
             {
-                // This is for when a client wants to get the list of games that he is joined
-                char *games_string = listGames(client_name);
-
-                char client_fifo[BUFSIZ];
-                snprintf(client_fifo, sizeof(client_fifo), "/tmp/my_fifo_response_%s", client_name);
-                mkfifo(client_fifo, 0666);
-                int pipe_fd_response = open(client_fifo, O_WRONLY);
-                write(pipe_fd_response, games_string, strlen(games_string) + 1);
-                close(pipe_fd_response);
-                free(games_string);
-                games_string = NULL;
+                flushConnection(connection);
             }
-            if (strncmp(command, "GI", 2) == 0)
+            if (connection->active && (events[i].events & EVENT_READ) && transport->serverRead != NULL)
             {
-                // This is for when a client wants to get the information about a game
-                char *command_copy = strdup(command);
-                char *token = strtok_r(command_copy, ",", &saveptr1);
-
-                if (token && strncmp(token, "GI", 2) == 0)
-                {
-                    char *game_id_string = strtok_r(NULL, ",", &saveptr1);
-                    if (game_id_string == NULL)
-                    {
-                        printf("Error: Invalid command format\n");
-                        continue;
-                    }
-                    int game_id = atoi(game_id_string);
-                    char response[BUFSIZ];
-                    response[0] = '\0';
-
-                    // Get the game info string and send it to the client
-                    char *game_info = getGameInfo(game_id);
-                    // If the game not started yet send that instead of the game info string
-                    if (strcmp(game_info, "notstarted") == 0)
-                    {
-                        strcat(response, "notstarted");
-                    }
-                    else
-                    {
-                        strncat(response, game_info, BUFSIZ - strlen(response) - 1);
-                    }
-                    free(game_info);
-                    game_info = NULL;
-
-                    char client_fifo[BUFSIZ];
-                    snprintf(client_fifo, sizeof(client_fifo), "/tmp/my_fifo_response_%s", client_name);
-                    mkfifo(client_fifo, 0666);
-                    int pipe_fd_response = open(client_fifo, O_WRONLY);
-                    write(pipe_fd_response, response, strlen(response) + 1);
-                    close(pipe_fd_response);
-                }
-                free(command_copy);
-                command_copy = NULL;
+                transport->serverRead(connection);
             }
-            if (strncmp(command, "MD", 2) == 0)
+            else if (connection->active && (events[i].events & EVENT_CLOSED))
             {
-                // This is for when a client wants to make a decision
-                char *command_copy = strdup(command);
-                char *token = strtok_r(command_copy, ",", &saveptr1);
-                // Get all necessary information from the command string and call the makeDecision function
-                if (token && strncmp(token, "MD", 2) == 0)
-                {
-                    char *game_id_string = strtok_r(NULL, ",", &saveptr1);
-                    char *decision_string = strtok_r(NULL, ",", &saveptr1);
-                    makeDecision(game_id_string, decision_string, client_name);
-                }
+                // The client closed its end of the channel
+                closeConnection(connection);
             }
         }
-
-        close(pipe_fd);
     }
 }
 
@@ -677,12 +4703,16 @@ void server(void)
 // ---------------------- CLIENT --------------------------
 // --------------------------------------------------------
 
+// Request and response channels of the client. With the socket transport both are the same connection.
 int pipe_fd;
+int pipe_fd_response = -1;
 const char *client_id;
 
 // Handle SIGINT signal (Ctrl+C)
 void handle_client_sigint(int sig)
 {
+    // Let the server close our response channel
+    commandSender("Q");
     clear();
     printw("Quitting...\n");
     refresh();
@@ -712,43 +4742,356 @@ void handle_sigpipe(int sig)
     exit(1);
 }
 
+// The correlation id of the last request. The response to a request carries the same id.
+uint32_t last_correlation_id = 0;
+
 // This function is used to send a command to the server
+// The command is the control code and its arguments, for example "JG,3". It is sent as one message.
 void commandSender(const char *command)
 {
-    char message[BUFSIZ + 256];
+    char message[sizeof(FrameHeader) + MAX_REQUEST_PAYLOAD];
+    const char *comma = strchr(command, ',');
+    size_t control_length = comma != NULL ? (size_t)(comma - command) : strlen(command);
+    const char *args = comma != NULL ? comma + 1 : "";
+    size_t args_length = strlen(args);
+    if (args_length > MAX_REQUEST_PAYLOAD)
+    {
+        fprintf(stderr, "Error: Command too long\n");
+        return;
+    }
+
+    // The client id is in the header so the server knows which client sent the command
+    // The client always asks for binary responses
+    last_correlation_id++;
+    size_t length = encodeFrame(message, findCommandCode(command, control_length), last_correlation_id, FRAME_FLAG_BINARY, client_id, args, args_length);
+
+    // Write the message to the server
+    transport->clientSend(message, length);
+}
+
+// This function opens the client's end of its response FIFO. It is called once before registering and kept open for the whole session.
+void openResponseChannel(void)
+{
+    char fifo_file_response[BUFSIZ];
+    snprintf(fifo_file_response, sizeof(fifo_file_response), "%s_%s", FIFO_FILE_RESPONSE, client_id);
+    mkfifo(fifo_file_response, 0666);
+    // Opening with O_NONBLOCK does not wait for the server, so the registration can be sent after it
+    pipe_fd_response = open(fifo_file_response, O_RDONLY | O_NONBLOCK);
+    if (pipe_fd_response < 0)
+    {
+        fprintf(stderr, "Error opening response channel\n");
+        exit(EXIT_FAILURE);
+    }
+    // Reads are blocking from now on
+    fcntl(pipe_fd_response, F_SETFL, fcntl(pipe_fd_response, F_GETFL) & ~O_NONBLOCK);
+}
+
+bool fifoClientConnect(void)
+{
+    pipe_fd = open(FIFO_FILE, O_WRONLY);
+    if (pipe_fd < 0)
+    {
+        return false;
+    }
+    openResponseChannel();
+    return true;
+}
+
+bool fifoClientSend(const char *message, size_t length)
+{
+    return write(pipe_fd, message, length) == (ssize_t)length;
+}
+
+// Blocks until data arrives. Returns 0 if the server closed the channel.
+ssize_t fifoClientReceive(char *buffer, size_t size, int timeout_ms)
+{
+    static bool server_connected = false;
+    while (true)
+    {
+        if (timeout_ms >= 0 && !waitReadable(pipe_fd_response, timeout_ms))
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        ssize_t result = read(pipe_fd_response, buffer, size);
+        if (result > 0)
+        {
+            server_connected = true;
+            return result;
+        }
+        if (result == 0 && !server_connected)
+        {
+            // The server did not open its end of the channel yet
+            if (timeout_ms >= 0)
+            {
+                errno = EAGAIN;
+                return -1;
+            }
+            usleep(1000);
+        }
+        else if (result == 0 || errno != EINTR)
+        {
+            return result;
+        }
+    }
+}
+
+bool socketClientConnect(void)
+{
+    pipe_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (pipe_fd < 0)
+    {
+        return false;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, SOCKET_FILE, sizeof(address.sun_path) - 1);
+    if (connect(pipe_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        return false;
+    }
+    pipe_fd_response = pipe_fd;
+    return true;
+}
+
+bool socketClientSend(const char *message, size_t length)
+{
+    return send(pipe_fd, message, length, 0) == (ssize_t)length;
+}
+
+// Blocks until a packet arrives. Returns 0 as soon as the server is gone.
+ssize_t socketClientReceive(char *buffer, size_t size, int timeout_ms)
+{
+    if (timeout_ms >= 0 && !waitReadable(pipe_fd_response, timeout_ms))
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    ssize_t result;
+    do
+    {
+        result = recv(pipe_fd_response, buffer, size, 0);
+    } while (result < 0 && errno == EINTR);
+    return result;
+}
+
+// The response ring the client claimed in the shared memory segment
+int shm_ring = -1;
+uint32_t shm_generation = 0;
+
+bool shmClientConnect(void)
+{
+    shm_segment = shmMap(false);
+    if (shm_segment == NULL || atomic_load(&shm_segment->server_pid) == 0)
+    {
+        return false;
+    }
+    uint32_t pid = (uint32_t)getpid();
+    for (int i = 0; i < SHM_MAX_CLIENTS && shm_ring < 0; i++)
+    {
+        ShmResponseRing *ring = &shm_segment->responses[i];
+        uint32_t owner = atomic_load(&ring->owner);
+        // A ring is free if nobody owns it or its owner died without giving it back
+        if (owner == 0 || (kill((pid_t)owner, 0) < 0 && errno == ESRCH))
+        {
+            if (atomic_compare_exchange_strong(&ring->owner, &owner, pid))
+            {
+                // Drop whatever the previous owner left in the ring
+                atomic_store(&ring->head, atomic_load(&ring->tail));
+                shm_generation = atomic_fetch_add(&ring->generation, 1) + 1;
+                shm_ring = i;
+            }
+        }
+    }
+    return shm_ring >= 0;
+}
+
+// Returns true if the server process still exists
+bool shmServerAlive(void)
+{
+    pid_t server_pid = (pid_t)atomic_load(&shm_segment->server_pid);
+    return !(kill(server_pid, 0) < 0 && errno == ESRCH);
+}
+
+bool shmClientSend(const char *message, size_t length)
+{
+    // If the ring is full wait until the server catches up
+    while (!shmRequestPush(&shm_segment->requests, (uint16_t)shm_ring, shm_generation, message, length))
+    {
+        if (length > sizeof(shm_segment->requests.slots[0].data) || !shmServerAlive())
+        {
+            return false;
+        }
+        usleep(10);
+    }
+    return true;
+}
+
+// Blocks until data arrives. Returns 0 if the server is gone.
+ssize_t shmClientReceive(char *buffer, size_t size, int timeout_ms)
+{
+    ShmResponseRing *ring = &shm_segment->responses[shm_ring];
+    bool waited = false;
+    while (true)
+    {
+        uint32_t futex = atomic_load(&ring->futex);
+        size_t length = shmResponseRead(ring, buffer, size);
+        if (length > 0)
+        {
+            return (ssize_t)length;
+        }
+        if (!shmServerAlive())
+        {
+            return 0;
+        }
+        if (timeout_ms >= 0 && waited)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        // Wake up from time to time to check if the server is still there
+        futexWait(&ring->futex, futex, timeout_ms >= 0 ? timeout_ms : 500);
+        waited = true;
+    }
+}
+
+// Returns true if fd has data to read (or was closed) within timeout_ms
+bool waitReadable(int fd, int timeout_ms)
+{
+    struct pollfd descriptor = {.fd = fd, .events = POLLIN};
+    int result;
+    do
+    {
+        result = poll(&descriptor, 1, timeout_ms);
+    } while (result < 0 && errno == EINTR);
+    return result > 0;
+}
+
+// Messages received from the server that are not handled yet
+FrameReader client_reader;
 
-    // Cat the command to the client id so the server knows which client sent the command
-    snprintf(message, sizeof(message), "%s: %s", client_id, command);
+// The last game update the server pushed, NULL if there is none
+char *game_update = NULL;
+size_t game_update_length = 0;
+
+// Read what the server sent into client_reader. Waits at most timeout_ms (-1 waits until something arrives).
+// Returns false if nothing arrived.
+bool receiveFromServer(int timeout_ms)
+{
+    char *space = frameReaderReserve(&client_reader, BUFSIZ);
+    ssize_t length = transport->clientReceive(space, BUFSIZ, timeout_ms);
+    if (length < 0 && errno == EAGAIN)
+    {
+        return false;
+    }
+    if (length <= 0)
+    {
+        // The server closed the channel
+        handle_sigpipe(0);
+    }
+    frameReaderCommit(&client_reader, (size_t)length);
+    return true;
+}
 
-    // Write the formatted message to the pipe
-    write(pipe_fd, message, strlen(message) + 1);
+// Take the next received message that is not a pushed update. The pushed updates are kept in game_update,
+// only the newest one is interesting. Returns false if there is no complete message.
+bool nextFromServer(FrameHeader *header, const char **payload)
+{
+    while (true)
+    {
+        int result = frameReaderNext(&client_reader, header, payload);
+        if (result < 0)
+        {
+            handle_sigpipe(0);
+        }
+        if (result == 0)
+        {
+            return false;
+        }
+        if (!(header->flags & FRAME_FLAG_PUSH))
+        {
+            return true;
+        }
+        char *update = realloc(game_update, header->length);
+        if (update == NULL && header->length > 0)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(update, *payload, header->length);
+        game_update = update;
+        game_update_length = header->length;
+    }
 }
 
 // This function is used to read the response from the server. It is called every time a client expects a response.
-char *readFromServer(void)
+// Bytes after the response belong to the next one and are kept for the next call.
+// Responses to older requests are skipped, only the answer to the last request is returned.
+// The header of the response is put into header. The payload is null terminated, header->length does not count it.
+char *readResponse(FrameHeader *header)
 {
-    int pipe_fd_response;
-    char buf[BUFSIZ];
-    char *message = malloc(BUFSIZ * sizeof(char));
+    const char *payload;
+    while (true)
+    {
+        if (!nextFromServer(header, &payload))
+        {
+            receiveFromServer(-1);
+        }
+        else if (header->correlation_id == last_correlation_id)
+        {
+            break;
+        }
+    }
+
+    // Since this is a dedicated channel, we don't need to check if the message is for this client
+    char *message = malloc(header->length + 1);
     if (message == NULL)
     {
         fprintf(stderr, "Memory allocation failed\n");
         exit(EXIT_FAILURE);
     }
+    memcpy(message, payload, header->length);
+    message[header->length] = '\0';
+    return message;
+}
 
-    // Construct the name of the dedicated pipe using the client's ID
-    char fifo_file_response[BUFSIZ];
-    sprintf(fifo_file_response, "/tmp/my_fifo_response_%s", client_id);
+// The same as readResponse() for the text responses
+char *readFromServer(void)
+{
+    FrameHeader header;
+    return readResponse(&header);
+}
 
-    // Open the dedicated pipe for reading
-    pipe_fd_response = open(fifo_file_response, O_RDONLY);
-    if (read(pipe_fd_response, buf, BUFSIZ) > 0)
+// Take the last pushed game update. The caller frees it. Returns NULL if there is none.
+char *takeGameUpdate(size_t *length)
+{
+    char *update = game_update;
+    *length = game_update_length;
+    game_update = NULL;
+    game_update_length = 0;
+    return update;
+}
+
+// Wait for a key press. If the server pushes a game update meanwhile KEY_GAME_UPDATE is returned instead.
+int waitForKey(void)
+{
+    // getch() gives up after a short time, so the updates are noticed while waiting for the player
+    timeout(20);
+    int key = ERR;
+    while (key == ERR)
     {
-        // Since this is a dedicated pipe, we don't need to check if the message is for this client
-        strcpy(message, buf);
+        FrameHeader header;
+        const char *payload;
+        receiveFromServer(0);
+        // Only pushed updates are expected here, older responses are dropped
+        while (nextFromServer(&header, &payload))
+        {
+        }
+        key = game_update != NULL ? KEY_GAME_UPDATE : getch();
     }
-    close(pipe_fd_response);
-    return message;
+    timeout(-1);
+    return key;
 }
 
 // This function checks if the client id is valid
@@ -818,62 +5161,13 @@ void showMenu(void)
 // This is the option 3 from the menu. It displays the waiting rooms.
 void displayWaitingRooms(bool prevJoined, int prevJoinedId, bool cantjoin)
 {
-    clear();
-    printw("Here's the list of games you can join:\n");
-    int game_ids[BUFSIZ];
-    int games_count = 0;
-
-    usleep(100000);
-    // Send the command to the server to get the list of waiting games
-    commandSender("SW");
-    // Read the response from the server using the readFromServer function
-    char *message = readFromServer();
-    char *saveptr1;
-    char *token = strtok_r(message, ",", &saveptr1);
-    while (token != NULL)
-    {
-        game_ids[games_count] = atoi(token);
-        games_count++;
-        token = strtok_r(NULL, ",", &saveptr1);
-    }
-    // If the string is empty there are no games to join
-    if (games_count == 0)
-    {
-        printw("\n");
-        printw("Sorry. There are no games you can join");
-        printw("\n");
-    }
-    else
-    {
-        printw("\n");
-    }
-    // Print the list of games, assign a number key to each game
-    for (int i = 0; i < games_count; i++)
-    {
-        printw("%d - Game #%d\n", i + 1, game_ids[i]);
-    }
-    // Check if the client tried to join a game and display a message accordingly
-    // If there client already wanted to join the game the displaying is different
-    if (prevJoined)
-    {
-        // check if the previous join was successful or not
-        if (cantjoin == 1)
-        {
-            printw("\n");
-            printw(">>> You cannot join Game #%d <<<\n", prevJoinedId);
-        }
-        else if (cantjoin == 0)
-        {
-            printw("\n");
-            printw(">>> You joined Game #%d <<<\n", prevJoinedId);
-        }
-    }
-    printw("\n");
-    printw("b - Back\n");
-    refresh();
+    // The server sends a page of rooms at a time, so the list works for any number of rooms
+    LobbySort sort = LOBBY_BY_AGE;
+    uint64_t cursor = 0;
+    LobbyPage page;
+    drawWaitingRooms(sort, cursor, &page, prevJoined, prevJoinedId, cantjoin);
+    char *message = NULL;
     bool quit = false;
-    free(message);
-    message = NULL;
     do
     {
         char command = (char)getch();
@@ -882,12 +5176,25 @@ void displayWaitingRooms(bool prevJoined, int prevJoinedId, bool cantjoin)
             showMenu();
             quit = true;
         }
+        else if (command == 'n')
+        {
+            // After the last page the list starts again
+            cursor = page.next_cursor;
+            drawWaitingRooms(sort, cursor, &page, false, 0, false);
+        }
+        else if (command == 'o')
+        {
+            sort = sort == LOBBY_BY_AGE ? LOBBY_BY_FILL : LOBBY_BY_AGE;
+            cursor = 0;
+            drawWaitingRooms(sort, cursor, &page, false, 0, false);
+        }
         int commandInt = command - '0';
         // Check if the key pressed is a number key and if it is a valid number key for a game
-        if (commandInt >= 1 && commandInt <= games_count)
+        if (commandInt >= 1 && commandInt <= page.count)
         {
+            int game_id = page.rooms[commandInt - 1].game_id;
             char commandString[BUFSIZ];
-            snprintf(commandString, sizeof(commandString), "JG,%d", game_ids[commandInt - 1]);
+            snprintf(commandString, sizeof(commandString), "JG,%d", game_id);
             commandSender(commandString);
             usleep(100000);
             message = readFromServer();
@@ -898,205 +5205,202 @@ void displayWaitingRooms(bool prevJoined, int prevJoinedId, bool cantjoin)
                 free(message);
                 message = NULL;
                 quit = true;
-                displayWaitingRooms(true, game_ids[commandInt - 1], 0);
+                displayWaitingRooms(true, game_id, 0);
             }
             else if (strcmp(message, "notjoined") == 0)
             {
                 free(message);
                 message = NULL;
                 quit = true;
-                displayWaitingRooms(true, game_ids[commandInt - 1], 1);
+                displayWaitingRooms(true, game_id, 1);
             }
         }
     } while (!quit);
 }
 
-// This function is used to display the current state of the game when a player enters
-void displayGame(int game_id)
+// Ask the server for a page of the rooms after cursor and show it
+void drawWaitingRooms(LobbySort sort, uint64_t cursor, LobbyPage *page, bool prevJoined, int prevJoinedId, bool cantjoin)
 {
     clear();
+    printw("Here's the list of games you can join:\n");
+
     usleep(100000);
-    char commandString[BUFSIZ];
-    // Send the command to the server to get the game info with the ID of the game
-    snprintf(commandString, sizeof(commandString), "GI,%d", game_id);
+    // Send the command to the server to get a page of the waiting games
+    char commandString[64];
+    snprintf(commandString, sizeof(commandString), "LQ,%d,%c,%llu", LOBBY_SCREEN_ROWS, sort, (unsigned long long)cursor);
     commandSender(commandString);
-    char *message = readFromServer();
-    // Check if the game is started or not
-    if (strcmp(message, "notstarted") == 0)
+    // Read the response from the server using the readResponse function
+    FrameHeader header;
+    char *message = readResponse(&header);
+    if (!decodeLobbyPage((const uint8_t *)message, header.length, page))
+    {
+        memset(page, 0, sizeof(*page));
+    }
+    free(message);
+    // If the list is empty there are no games to join
+    if (page->count == 0)
     {
-        printw(">>> Game #%d has not started yet <<<\n", game_id);
         printw("\n");
-        printw("r - Refresh\n");
-        printw("b - Back\n");
-        refresh();
-        bool quit = false;
-        free(message);
-        message = NULL;
-        do
-        {
-            char command = (char)getch();
-            if (command == 'b')
-            {
-                quit = true;
-                showMenu();
-            }
-            if (command == 'r')
-            {
-                quit = true;
-                displayGame(game_id);
-            }
-        } while (!quit);
+        printw("Sorry. There are no games you can join");
+        printw("\n");
     }
-    // This part is for converting the game info string to a Game struct
-
-    // Make a copy of the message to avoid modifying the original string
-    char *messageCopy = strdup(message);
-    if (messageCopy == NULL)
+    else
+    {
+        printw("\n");
+    }
+    // Print the list of games, assign a number key to each game
+    for (int i = 0; i < page->count; i++)
     {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
+        printw("%d - Game #%d (%d/%d players, %d rounds)\n", i + 1, page->rooms[i].game_id, page->rooms[i].num_joined,
+               page->rooms[i].num_players, page->rooms[i].num_rounds);
     }
-
-    char *token;
-
-    // Create Game struct
-    Game currentGame;
-
-    // Parse number of players
-    token = strtok(messageCopy, ";");
-    token = strtok(NULL, ";");
-    currentGame.num_players = atoi(token);
-
-    // Parse player names
-    for (int i = 0; i < currentGame.num_players; i++)
+    // Check if the client tried to join a game and display a message accordingly
+    // If there client already wanted to join the game the displaying is different
+    if (prevJoined)
     {
-        if (i == currentGame.num_players - 1)
+        // check if the previous join was successful or not
+        if (cantjoin == 1)
         {
-            token = strtok(NULL, ";");
+            printw("\n");
+            printw(">>> You cannot join Game #%d <<<\n", prevJoinedId);
         }
-        else
+        else if (cantjoin == 0)
         {
-            token = strtok(NULL, ",");
+            printw("\n");
+            printw(">>> You joined Game #%d <<<\n", prevJoinedId);
         }
-        currentGame.playerNames[i] = strdup(token);
     }
+    printw("\n");
+    printw("n - Next page, o - Order by %s\n", sort == LOBBY_BY_AGE ? "free seats" : "age");
+    printw("b - Back\n");
+    refresh();
+}
 
-    // Parse current round and max rounds
-    token = strtok(NULL, ",");
-    currentGame.current_round = atoi(token);
-    token = strtok(NULL, ";");
-    currentGame.num_rounds = atoi(token);
+// The client's copy of the game on the screen, kept up to date with the pushed deltas
+GameState current_game;
 
-    // Parse player scores
-    for (int i = 0; i < currentGame.num_players; i++)
+// This function is used to display the current state of the game when a player enters
+// The game is drawn again after every change the server pushes, until the player goes back to the menu
+void displayGame(int game_id)
+{
+    followGame(game_id);
+    while (drawGame(game_id))
     {
-        if (i == currentGame.num_players - 1)
-        {
-            token = strtok(NULL, ";");
-        }
-        else
+        if (!redrawGame(game_id))
         {
-            token = strtok(NULL, ",");
+            // The copy is out of sync, start again with the full game
+            followGame(game_id);
         }
-        currentGame.playerScores[i] = atoi(strdup(token));
     }
+    leaveGame();
+}
 
-    // Parse round data
-    for (int i = 0; i < currentGame.current_round; i++)
-    {
-        if (i == currentGame.current_round - 1)
-        {
-            token = strtok(NULL, ";");
-        }
-        else
-        {
-            token = strtok(NULL, ",");
-        }
-        currentGame.roundData[i] = strdup(token);
-    }
-    free(messageCopy);
-    messageCopy = NULL;
+// The client subscribes to the game, the server answers with the current state and pushes every change after it
+void followGame(int game_id)
+{
+    char commandString[BUFSIZ];
+    // Send the command to the server to follow the game with the ID of the game
+    snprintf(commandString, sizeof(commandString), "SU,%d", game_id);
+    commandSender(commandString);
+    FrameHeader header;
+    char *message = readResponse(&header);
+    memset(&current_game, 0, sizeof(current_game));
+    applyGameUpdate(game_id, message, header.length);
+    free(message);
+}
 
-    // The displaying starts here
+// Apply a game update (the game ID and a game delta) to the client's copy of the game. Returns false if it does not fit.
+bool applyGameUpdate(int game_id, const char *message, size_t length)
+{
+    const uint8_t *cursor = (const uint8_t *)message;
+    const uint8_t *end = cursor + length;
+    uint32_t update_game_id = 0;
+    return getVarint(&cursor, end, &update_game_id) && (int)update_game_id == game_id &&
+           applyGameDelta(&current_game, cursor, (size_t)(end - cursor));
+}
 
-    // Calculate the length of the separation line
-    int sepLineLength = 8 * (currentGame.num_players) + 9;
+// Leave the game screen and go back to the menu, the server stops pushing the updates of the game
+void leaveGame(void)
+{
+    commandSender("US");
+    free(game_update);
+    game_update = NULL;
+    showMenu();
+}
 
-    // Create the separation line
-    char sepLine[sepLineLength + 1]; // +1 for the null terminator
-    for (int i = 0; i < sepLineLength; i++)
-    {
-        sepLine[i] = '-';
-    }
-    sepLine[sepLineLength] = '\0';
+// Apply the new state of the game the server pushed, displayGame() draws it. Returns false if the copy is out of sync.
+bool redrawGame(int game_id)
+{
+    size_t length;
+    char *update = takeGameUpdate(&length);
+    bool applied = applyGameUpdate(game_id, update, length);
+    free(update);
+    return applied;
+}
 
-    if (currentGame.current_round > currentGame.num_rounds)
+// This function draws the client's copy of the game and handles the input of the player until the game changes.
+// Returns true if the server pushed a change, false if the player went back to the menu.
+bool drawGame(int game_id)
+{
+    clear();
+    // The copy is read in place, it is too big to copy for every redraw
+    const GameState *currentGame = &current_game;
+    // Check if the game is started or not
+    if (!currentGame->started)
     {
-        // If the game is finished display the finished game
-        printw("Game #%d - Finished\n", game_id);
-        printw("\n%s\n", sepLine);
-        printw("| Round |");
-        // Display player names
-        for (int i = 0; i < currentGame.num_players; i++)
-        {
-            printw(" %-5s |", currentGame.playerNames[i]);
-        }
-        printw("\n%s\n", sepLine);
+        printw(">>> Game #%d has not started yet <<<\n", game_id);
+        printw("\n");
+        printw("The game starts as soon as it is full\n");
+        printw("b - Back\n");
         refresh();
-        // Display round data
-        for (int i = 0; i < currentGame.num_rounds; i++)
+        do
         {
-            printw("| %5d |", i + 1);
-            // Tokenize the roundData string to extract each player's decision
-            for (int j = 0; j < currentGame.num_players; j++)
+            int command = waitForKey();
+            if (command == 'b')
             {
-                if (currentGame.roundData[i][j] == 'n')
-                {
-                    printw(" %5c |", ' ');
-                }
-                else
-                {
-                    printw(" %5c |", currentGame.roundData[i][j]);
-                }
+                return false;
             }
-            printw("\n%s\n", sepLine);
-        }
+            if (command == KEY_GAME_UPDATE)
+            {
+                // Someone joined or the game started
+                return true;
+            }
+        } while (true);
+    }
 
-        // Display player scores
-        printw("\n%s\n", sepLine);
-        printw("|  Pts  |");
-        for (int i = 0; i < currentGame.num_players; i++)
-        {
-            printw(" %5d |", currentGame.playerScores[i]);
-        }
-        printw("\n%s\n", sepLine);
+    // The displaying starts here
+    if (currentGame->current_round > currentGame->num_rounds)
+    {
+        // If the game is finished display the finished game
+        printw("Game #%d - Finished\n", game_id);
+        drawGameTable(currentGame, currentGame->num_rounds);
 
         // Display the winner
         printw("\n>>> Game over! Winner(s): ");
         // In order to print the winners in the correct order we need to find the max score
         // find max score
         int maxScore = 0;
-        for (int i = 0; i < currentGame.num_players; i++)
+        for (int i = 0; i < currentGame->num_players; i++)
         {
-            if (currentGame.playerScores[i] > maxScore)
+            if (currentGame->scores[i] > maxScore)
             {
-                maxScore = currentGame.playerScores[i];
+                maxScore = currentGame->scores[i];
             }
         }
         // print winners, only put comma if multiple winners
         int winnerCount = 0;
-        for (int i = 0; i < currentGame.num_players; i++)
+        for (int i = 0; i < currentGame->num_players; i++)
         {
-            if (currentGame.playerScores[i] == maxScore)
+            if (currentGame->scores[i] == maxScore)
             {
                 winnerCount++;
             }
         }
-        for (int i = 0; i < currentGame.num_players; i++)
+        for (int i = 0; i < currentGame->num_players; i++)
         {
-            if (currentGame.playerScores[i] == maxScore)
+            if (currentGame->scores[i] == maxScore)
             {
-                printw("%s", currentGame.playerNames[i]);
+                printw("%s", currentGame->player_ids[i]);
                 winnerCount--;
                 if (winnerCount > 0)
                 {
@@ -1109,68 +5413,28 @@ void displayGame(int game_id)
         // Display the options
         printw("\nb - Back\n");
         refresh();
-        bool quit = false;
         do
         {
             char command = (char)getch();
             // Only option from here is to go back to the menu, the player cannot come back here
             if (command == 'b')
             {
-                quit = true;
-                showMenu();
+                return false;
             }
-        } while (!quit);
-        return;
+        } while (true);
     }
 
     // If the game is not finished display the current state of the game
-    printw("Game #%d - Next Round %d/%d\n\n", game_id, currentGame.current_round, currentGame.num_rounds);
-    // Display the top border of the table
-    printw("\n%s\n", sepLine);
-    printw("| Round |");
-    refresh();
-    // Display player names
-    for (int i = 0; i < currentGame.num_players; i++)
-    {
-        printw(" %-5s |", currentGame.playerNames[i]);
-    }
-    printw("\n%s\n", sepLine);
-    refresh();
-    // Display round data
-    for (int i = 0; i < currentGame.current_round - 1; i++)
-    {
-        printw("| %5d |", i + 1);
-        // Tokenize the roundData string to extract each players decision
-        for (int j = 0; j < currentGame.num_players; j++)
-        {
-            if (currentGame.roundData[i][j] == 'n')
-            {
-                printw(" %5c |", ' ');
-            }
-            else
-            {
-                printw(" %5c |", currentGame.roundData[i][j]);
-            }
-        }
-        printw("\n%s\n", sepLine);
-    }
-
-    // Display player scores
-    printw("\n%s\n", sepLine);
-    printw("|  Pts  |");
-    for (int i = 0; i < currentGame.num_players; i++)
-    {
-        printw(" %5d |", currentGame.playerScores[i]);
-    }
-    printw("\n%s\n", sepLine);
+    printw("Game #%d - Next Round %d/%d\n\n", game_id, currentGame->current_round, currentGame->num_rounds);
+    drawGameTable(currentGame, currentGame->current_round - 1);
 
     // check if already made a decision
     bool madeDecision = false;
-    for (int i = 0; i < currentGame.num_players; i++)
+    for (int i = 0; i < currentGame->num_players; i++)
     {
-        if (strcmp(currentGame.playerNames[i], client_id) == 0)
+        if (strcmp(currentGame->player_ids[i], client_id) == 0)
         {
-            if (currentGame.roundData[currentGame.current_round - 1][i] != 'n')
+            if (gameStateMove(currentGame, currentGame->current_round - 1, i) != 'n')
             {
                 madeDecision = true;
                 break;
@@ -1187,38 +5451,39 @@ void displayGame(int game_id)
         refresh();
 
         // Handle user input
-        bool quit = false;
+        bool decided = false;
         do
         {
-            char command = (char)getch();
+            int command = waitForKey();
             if (command == 'b')
             {
-                quit = true;
-                showMenu();
+                return false;
             }
-            if (command == 'p' || command == 'r' || command == 's')
+            if (!decided && (command == 'p' || command == 'r' || command == 's'))
             {
                 // Send the decision to the server
-                commandString[0] = '\0';
+                char commandString[BUFSIZ];
                 snprintf(commandString, sizeof(commandString), "MD,%d,%c", game_id, command);
                 commandSender(commandString);
-                quit = true;
-                usleep(100000);
-                // After sending the decision restart the function to display the updated game
-                displayGame(game_id);
+                // The server pushes the updated game, it is displayed when it arrives
+                decided = true;
+            }
+            if (command == KEY_GAME_UPDATE)
+            {
+                return true;
             }
-        } while (!quit);
+        } while (true);
     }
     else
     {
         // check what the player chose
         char playerDecision;
         playerDecision = '\0';
-        for (int i = 0; i < currentGame.num_players; i++)
+        for (int i = 0; i < currentGame->num_players; i++)
         {
-            if (strcmp(currentGame.playerNames[i], client_id) == 0)
+            if (strcmp(currentGame->player_ids[i], client_id) == 0)
             {
-                playerDecision = currentGame.roundData[currentGame.current_round - 1][i];
+                playerDecision = gameStateMove(currentGame, currentGame->current_round - 1, i);
                 break;
             }
         }
@@ -1238,29 +5503,89 @@ void displayGame(int game_id)
         }
 
         // Display the options
-        printw("\nr - Refresh\n");
-        printw("b - Back\n");
+        printw("\nb - Back\n");
         refresh();
 
         // Handle user input
-        bool quit = false;
         do
         {
-            char command = (char)getch();
+            int command = waitForKey();
             if (command == 'b')
             {
                 // The player can go back to the menu
-                quit = true;
-                showMenu();
+                return false;
             }
-            if (command == 'r')
+            if (command == KEY_GAME_UPDATE)
             {
-                // Or refresh the game to see if the other players made their decisions
-                quit = true;
-                displayGame(game_id);
+                // The other players made their decisions or the round ended
+                return true;
             }
-        } while (!quit);
+        } while (true);
+    }
+}
+
+// Draw the table of the rounds and the points of the players. A game can have more players and rounds than fit on
+// the screen, then only the columns up to the client's own column and the last rounds are shown.
+void drawGameTable(const GameState *game, int num_rounds)
+{
+    // The round column is 9 characters wide and every player column is 8
+    int columns = (COLS - 9) / 8;
+    columns = columns < 1 ? 1 : columns;
+    columns = columns > game->num_players ? game->num_players : columns;
+    int first_player = 0;
+    for (int i = 0; i < game->num_players; i++)
+    {
+        if (strcmp(game->player_ids[i], client_id) == 0 && i >= columns)
+        {
+            first_player = i - columns + 1;
+        }
+    }
+    // Every round takes two lines, the rest of the screen is for the title, the points and the options
+    int rows = (LINES - 16) / 2;
+    rows = rows < 1 ? 1 : rows;
+    int first_round = num_rounds > rows ? num_rounds - rows : 0;
+    if (columns < game->num_players || first_round > 0)
+    {
+        printw("Players %d-%d of %d, rounds %d-%d of %d\n", first_player + 1, first_player + columns, game->num_players,
+               first_round + 1, num_rounds, game->num_rounds);
+    }
+
+    // Create the separation line
+    int sepLineLength = 8 * columns + 9;
+    char sepLine[sepLineLength + 1]; // +1 for the null terminator
+    memset(sepLine, '-', (size_t)sepLineLength);
+    sepLine[sepLineLength] = '\0';
+
+    printw("\n%s\n", sepLine);
+    printw("| Round |");
+    // Display player names
+    for (int i = first_player; i < first_player + columns; i++)
+    {
+        printw(" %-5s |", game->player_ids[i]);
+    }
+    printw("\n%s\n", sepLine);
+    // Display round data
+    for (int i = first_round; i < num_rounds; i++)
+    {
+        printw("| %5d |", i + 1);
+        // Get each player's decision from the packed moves
+        for (int j = first_player; j < first_player + columns; j++)
+        {
+            char decision = gameStateMove(game, i, j);
+            printw(" %5c |", decision == 'n' ? ' ' : decision);
+        }
+        printw("\n%s\n", sepLine);
+    }
+
+    // Display player scores
+    printw("\n%s\n", sepLine);
+    printw("|  Pts  |");
+    for (int i = first_player; i < first_player + columns; i++)
+    {
+        printw(" %5d |", game->scores[i]);
     }
+    printw("\n%s\n", sepLine);
+    refresh();
 }
 
 // This function is to display the games that the player is joined
@@ -1270,18 +5595,11 @@ void showCurrentGames(void)
     printw("Here's the list of games you can play:\n");
     printw("\n");
     commandSender("SG");
-    char *message = readFromServer();
-    char *saveptr1;
-    char *token = strtok_r(message, ",", &saveptr1);
-    int game_ids[BUFSIZ];
-    int games_count = 0;
-    while (token != NULL)
-    {
-        game_ids[games_count] = atoi(token);
-        games_count++;
-        token = strtok_r(NULL, ",", &saveptr1);
-    }
-    if (games_count == 0)
+    FrameHeader header;
+    char *message = readResponse(&header);
+    int game_ids[MAX_GAMES];
+    int games_count = decodeGameList((const uint8_t *)message, header.length, game_ids, MAX_GAMES);
+    if (games_count <= 0)
     {
         printw("Sorry. There are no games you can play");
         printw("\n");
@@ -1319,81 +5637,124 @@ void showCurrentGames(void)
 void createNewGame(void)
 {
     clear();
-    printw("2:5 - How many players will play the game? min: 2 - max: 5\n");
+    printw("How many players will play the game? min: 2 - max: %d\n", MAX_GAME_PLAYERS);
+    printw("\n");
+    printw("b - Back\n\n> ");
+    refresh();
+    int playersn = readNumber(2, MAX_GAME_PLAYERS);
+    if (playersn == 0)
+    {
+        showMenu();
+        return;
+    }
+    clear();
+    printw("How many rounds will the game have? min: 3 - max: %d\n", MAX_GAME_ROUNDS);
+    printw("\n");
+    printw("b - Back\n\n> ");
+    refresh();
+    int rounds = readNumber(3, MAX_GAME_ROUNDS);
+    if (rounds == 0)
+    {
+        // Go back to the first question
+        createNewGame();
+        return;
+    }
+    char commandString[BUFSIZ];
+    snprintf(commandString, sizeof(commandString), "NG,%d,%d", playersn, rounds);
+    commandSender(commandString);
+    clear();
+    printw("Game created, you can join from the menu\n");
     printw("\n");
     printw("b - Back\n");
     refresh();
-    bool quit = false;
-    int playersn = 0;
-    bool gamecreated = false;
-    bool secondquestion = false;
-    do
+    while ((char)getch() != 'b')
     {
-        char command = (char)getch();
-        // If the player presses b check witch state of the game creation he is in
-        if (command == 'b')
-        {
-            // If they already entered the player number go back to the first question
-            if (secondquestion)
-            {
-                createNewGame();
-                quit = true;
-            }
-            else
-            {
-                showMenu();
-                quit = true;
-            }
-        }
-        // If the number of entered players is valid go to the next question
-        else if (playersn == 0 && atoi(&command) >= 2 && atoi(&command) <= 5 && !gamecreated)
+    }
+    showMenu();
+}
+
+// Read a number the user types and confirms with enter. It asks again until it is between min and max.
+// Returns 0 if the user typed b to go back.
+int readNumber(int min, int max)
+{
+    char input[16];
+    while (true)
+    {
+        echo();
+        getnstr(input, sizeof(input) - 1);
+        noecho();
+        if (strcmp(input, "b") == 0)
         {
-            secondquestion = true;
-            playersn = atoi(&command);
-            clear();
-            printw("3:5 - How many rounds will the game have? min: 3 - max: 5\n");
-            printw("\n");
-            printw("b - Back\n");
-            refresh();
+            return 0;
         }
-        // If the game way created display a message about it
-        else if (playersn != 0 && atoi(&command) >= 3 && atoi(&command) <= 5 && !gamecreated)
+        int value = atoi(input);
+        if (value >= min && value <= max)
         {
-            int rounds = atoi(&command);
-            char commandString[BUFSIZ];
-            snprintf(commandString, sizeof(commandString), "NG,%d,%d", playersn, rounds);
-            commandSender(commandString);
-            secondquestion = false;
-            clear();
-            printw("Game created, you can join from the menu\n");
-            printw("\n");
-            printw("b - Back\n");
-            refresh();
-            gamecreated = true;
+            return value;
         }
-    } while (!quit);
+        printw("It must be a number between %d and %d: ", min, max);
+        refresh();
+    }
 }
 
-// This function is used to show the leaderboard
+// Show the top 3 of the leaderboard and the place of the client. The server keeps the players in order,
+// so the client only gets these few players, not the whole leaderboard. The other players are shown a page at a time.
 void showLeaderboard(void)
 {
-    // Ask the server for the leaderboard
-    commandSender("4L");
+    // Ask the server for the top of the leaderboard
+    commandSender("LT,3");
     clear();
     printw("Leaderboard\n");
     printw("\n");
     refresh();
-    char currentPlayer[BUFSIZ];
-    strcpy(currentPlayer, client_id);
-    char *message = readFromServer();
-    // Call the parseMessage function to parse the leaderboard string
-    parseMessage(message, currentPlayer);
+    FrameHeader header;
+    char *message = readResponse(&header);
+    LeaderBoardTop top;
+    if (!decodeLeaderBoardTop((const uint8_t *)message, header.length, &top))
+    {
+        memset(&top, 0, sizeof(top));
+    }
+    free(message);
+    printLeaderboard(&top, client_id);
+    // 0 is the top 3, the pages are counted from 1
+    int page = 0;
+    int num_ranked = top.num_ranked;
+    LeaderBoardPage shown;
+    char command_string[32];
     bool quit = false;
     do
     {
         char command = (char)getch(); // Wait for a key press
         switch (command)
         {
+        case 'n':
+            if ((long)page * LEADERBOARD_SCREEN_ROWS < num_ranked)
+            {
+                page++;
+                snprintf(command_string, sizeof(command_string), "LP,%d,%d", page, LEADERBOARD_SCREEN_ROWS);
+                showLeaderboardPage(command_string, &shown);
+                num_ranked = shown.num_ranked;
+            }
+            break;
+        case 'p':
+            if (page > 1)
+            {
+                page--;
+                snprintf(command_string, sizeof(command_string), "LP,%d,%d", page, LEADERBOARD_SCREEN_ROWS);
+                showLeaderboardPage(command_string, &shown);
+                num_ranked = shown.num_ranked;
+            }
+            break;
+        case 'm':
+            // The players around the client, the next page continues from the page the client is on
+            snprintf(command_string, sizeof(command_string), "LR,%d", LEADERBOARD_SCREEN_ROWS / 2);
+            showLeaderboardPage(command_string, &shown);
+            num_ranked = shown.num_ranked;
+            if (shown.my_rank > 0)
+            {
+                page = (shown.my_rank - 1) / LEADERBOARD_SCREEN_ROWS + 1;
+            }
+            break;
         case 'b':
             quit = true;
             showMenu();
@@ -1404,80 +5765,63 @@ void showLeaderboard(void)
     } while (!quit);
 }
 
-// This function is used to get out the information about a game to be able to sort it properly.
-void parseMessage(char *message, char *currentPlayer)
-{
-    Player currentPlayers[MAX_PLAYERS];
-    int playerCount = 0;
-
-    char *saveptr1, *saveptr2;
-    char *playerToken = strtok_r(message, ";", &saveptr1);
-    while (playerToken != NULL)
-    {
-        char *name = strtok_r(playerToken, ",", &saveptr2);
-        char *score = strtok_r(NULL, ",", &saveptr2);
-        char *matches = strtok_r(NULL, ",", &saveptr2);
-
-        strncpy(currentPlayers[playerCount].name, name, sizeof(currentPlayers[playerCount].name));
-        currentPlayers[playerCount].score = atoi(score);
-        currentPlayers[playerCount].matches = atoi(matches);
-
-        playerCount++;
-
-        playerToken = strtok_r(NULL, ";", &saveptr1);
-    }
-    // Send the information to the printLeaderboard function
-    printLeaderboard(currentPlayers, playerCount, currentPlayer);
-    free(message);
-    message = NULL;
-}
-
-void printLeaderboard(Player currentPlayers[], int size, char *currentPlayer)
+void printLeaderboard(const LeaderBoardTop *top, const char *currentPlayer)
 {
-    // Sort the players based on the score and name
-    qsort(currentPlayers, (size_t)size, sizeof(Player), compare);
     // Display all information in the correct format
     printw("-----------------------------------\n");
     printw("| Rank | Player | Score | Matches |\n");
     printw("-----------------------------------\n");
-    // Check the number of players
-    int topPlayers = size < 3 ? size : 3;
     // Display the top 3 players first. If the current player is not in the top 3 display it after the top 3.
-    for (int i = 0; i < topPlayers; i++)
+    for (int i = 0; i < top->count; i++)
     {
-        printw("|%s  %2d | %6s | %5d | %7d |\n", strcmp(currentPlayers[i].name, currentPlayer) == 0 ? "*" : " ", i + 1, currentPlayers[i].name, currentPlayers[i].score, currentPlayers[i].matches);
+        printw("|%s  %2d | %6s | %5d | %7d |\n", strcmp(top->top[i].name, currentPlayer) == 0 ? "*" : " ", i + 1, top->top[i].name, top->top[i].score, top->top[i].matches);
         printw("-----------------------------------\n");
     }
     // If the current player is not in the top 3 display it after the top 3.
-    if (strcmp(currentPlayers[topPlayers - 1].name, currentPlayer) != 0)
+    if (top->my_rank > top->count)
     {
-        for (int i = topPlayers; i < size; i++)
-        {
-            if (strcmp(currentPlayers[i].name, currentPlayer) == 0)
-            {
-                printw("\n");
-                printw("-----------------------------------\n");
-                printw("|* %3d | %6s | %5d | %7d |\n", i + 1, currentPlayers[i].name, currentPlayers[i].score, currentPlayers[i].matches);
-                printw("-----------------------------------\n");
-                break;
-            }
-        }
+        printw("\n");
+        printw("-----------------------------------\n");
+        printw("|* %3d | %6s | %5d | %7d |\n", top->my_rank, currentPlayer, top->me.score, top->me.matches);
+        printw("-----------------------------------\n");
     }
     printw("\n");
+    printw("n - Next page, m - My place\n");
     printw("b - Back\n");
     refresh();
 }
 
-// This function is used to compare two players based on their score and name
-int compare(const void *a, const void *b)
+// Ask the server for a page of the leaderboard and show it
+void showLeaderboardPage(const char *command, LeaderBoardPage *page)
 {
-    Player *playerA = (Player *)a;
-    Player *playerB = (Player *)b;
-
-    if (playerA->score != playerB->score)
-        return playerB->score - playerA->score;
+    commandSender(command);
+    FrameHeader header;
+    char *message = readResponse(&header);
+    if (!decodeLeaderBoardPage((const uint8_t *)message, header.length, page))
+    {
+        memset(page, 0, sizeof(*page));
+    }
+    free(message);
+    clear();
+    printw("Leaderboard (%d players)\n", page->num_ranked);
+    printw("\n");
+    printLeaderboardPage(page, client_id);
+}
 
-    return strcmp(playerA->name, playerB->name);
+void printLeaderboardPage(const LeaderBoardPage *page, const char *currentPlayer)
+{
+    printw("-----------------------------------\n");
+    printw("| Rank | Player | Score | Matches |\n");
+    printw("-----------------------------------\n");
+    for (int i = 0; i < page->count; i++)
+    {
+        printw("|%s%4d | %6s | %5d | %7d |\n", strcmp(page->players[i].name, currentPlayer) == 0 ? "*" : " ", page->first_rank + i, page->players[i].name, page->players[i].score, page->players[i].matches);
+        printw("-----------------------------------\n");
+    }
+    printw("\n");
+    printw("n - Next page, p - Previous page, m - My place\n");
+    printw("b - Back\n");
+    refresh();
 }
 
 // This function initializes the client
@@ -1489,8 +5833,13 @@ void client(const char *id)
     noecho();             // Don't echo the typed characters
     keypad(stdscr, TRUE); // Enable function keys and arrow keys
 
-    pipe_fd = open(FIFO_FILE, O_WRONLY);
     client_id = id;
+    if (!transport->clientConnect())
+    {
+        endwin();
+        fprintf(stderr, "Error: Could not connect to the server\n");
+        exit(1);
+    }
 
     signal(SIGINT, handle_client_sigint);   // Register the SIGINT signal handler
     signal(SIGTERM, handle_client_sigterm); // Register the SIGTERM signal handler
@@ -1498,9 +5847,16 @@ void client(const char *id)
 
     // Try to connect to the server
     commandSender("C");
-    usleep(10000);
     // check response
-    char *message = readFromServer();
+    FrameHeader header;
+    char *message = readResponse(&header);
+    if (!(header.flags & FRAME_FLAG_BINARY))
+    {
+        // The server is too old, it only sends text responses
+        endwin();
+        fprintf(stderr, "Error: The server does not support the binary encoding\n");
+        exit(1);
+    }
     if (strcmp(message, "registered") == 0)
     {
         free(message);
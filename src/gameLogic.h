@@ -10,51 +10,686 @@
 #include <ctype.h>
 #include <pthread.h>
 #include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #ifndef GAMELOGIC_H
 #define GAMELOGIC_H
 
+#define FIFO_FILE "/tmp/my_fifo"
+#define FIFO_FILE_RESPONSE "/tmp/my_fifo_response"
+#define SOCKET_FILE "/tmp/my_socket"
+#define SHM_FILE "/my_shm"
+
+// Smallest size of the hash index of the players, it doubles when it is half full
+#define PLAYER_INDEX_MIN_SIZE 64
+// Most players the LT command sends from the top of the leaderboard
+#define MAX_LEADERBOARD_TOP 10
+// Most players of one page of the LP and LR commands
+#define MAX_LEADERBOARD_PAGE 100
+// Players on one page of the leaderboard screen of the client
+#define LEADERBOARD_SCREEN_ROWS 10
+// Most rooms of one page of the LQ command
+#define MAX_LOBBY_PAGE 50
+// Most open rooms one LQ command looks at, a query with filters that match few rooms returns a cursor to go on from
+#define LOBBY_SCAN_LIMIT 1024
+// Rooms on one page of the waiting room screen of the client, one digit key for each
+#define LOBBY_SCREEN_ROWS 9
+// Most games that exist at the same time. A game ID is the slot of the game in the low GAME_SLOT_BITS bits and the
+// generation of the slot above them, so the ID of a game whose slot was reused does not find the new game.
+#define GAME_SLOT_BITS 14
+#define MAX_GAMES (1 << GAME_SLOT_BITS)
+// The game table grows by this many slots at a time
+#define GAME_CHUNK_SIZE 256
+#define MAX_THREADS 100
+// Deadlines are kept in ticks of TIMER_TICK_MS. The timer wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SIZE
+// buckets, so it reaches TIMER_WHEEL_SIZE^TIMER_WHEEL_LEVELS ticks (about 19 days) ahead.
+#define TIMER_TICK_MS 100
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+// Longest --round-timeout and --lobby-timeout in seconds
+#define MAX_TIMEOUT 86400
+#define MAX_CONNECTIONS 1024
+#define MAX_BATCH 256
+#define MAX_LOOP_EVENTS 64
+// A client that does not read its responses is disconnected when this much data is waiting for it
+#define MAX_OUTBOUND_QUEUE (1024 * 1024)
+
+// Sizes of the shared memory transport
+#define SHM_REQUEST_SLOTS 1024        // Must be a power of two
+#define SHM_SLOT_SIZE 256             // A request has to fit into one slot
+#define SHM_MAX_CLIENTS 64            // Number of response rings
+#define SHM_RESPONSE_RING_SIZE 65536  // Must be a power of two
+
+// Largest payload of one message. Requests written to the FIFO also have to stay below PIPE_BUF, so they are never interleaved.
+#define MAX_FRAME_PAYLOAD (16 * 1024 * 1024)
+#define MAX_REQUEST_PAYLOAD 200
+// Flags of the message header
+#define FRAME_FLAG_BINARY 1 // Request: the client reads binary responses. Response: the payload is binary encoded.
+#define FRAME_FLAG_PUSH 2   // Response: sent by the server without a request, the correlation id is 0
+
+// waitForKey() returns this when the server pushed a game update
+#define KEY_GAME_UPDATE (KEY_MAX + 1)
+
+// Limits of one game. A game only allocates what its own number of players and rounds needs.
+#define MAX_GAME_PLAYERS 512
+#define MAX_GAME_ROUNDS 100
+// Player IDs are encoded as exactly this many bytes, shorter ones are padded with zeros
+#define PLAYER_ID_WIDTH 5
+// Largest binary encoded game info: status, 3 varints, the IDs, the scores and the packed moves
+#define GAME_INFO_MAX_SIZE (1 + 3 * 5 + MAX_GAME_PLAYERS * (PLAYER_ID_WIDTH + 5) + MAX_GAME_ROUNDS * ((MAX_GAME_PLAYERS + 3) / 4))
+// A game delta is the version, the kind and either the full game info or the changed parts (a round also has its index)
+#define GAME_DELTA_MAX_SIZE (6 + GAME_INFO_MAX_SIZE + MAX_GAME_ROUNDS * 2 + 32)
+// A client more than this many changes behind gets the full game instead of a delta
+#define GAME_DELTA_MAX_GAP 32
+// A pushed game update is the game ID as a varint and a game delta
+#define GAME_UPDATE_MAX_SIZE (5 + GAME_DELTA_MAX_SIZE)
+// Largest binary LT answer: 5 varints and an ID and 2 varints for every player of the top
+#define LEADERBOARD_TOP_MAX_SIZE (5 * 5 + MAX_LEADERBOARD_TOP * (PLAYER_ID_WIDTH + 2 * 5))
+// Largest binary LP or LR answer: 4 varints and an ID and 2 varints for every player of the page
+#define LEADERBOARD_PAGE_MAX_SIZE (4 * 5 + MAX_LEADERBOARD_PAGE * (PLAYER_ID_WIDTH + 2 * 5))
+// Largest binary LQ answer: the cursor, the count and 4 varints for every room
+#define LOBBY_PAGE_MAX_SIZE (10 + 5 + MAX_LOBBY_PAGE * 4 * 5)
+
+// Parts of a game in a delta
+#define DELTA_STATE 1   // started, num_players, current_round, num_rounds
+#define DELTA_PLAYERS 2 // The player IDs
+#define DELTA_SCORES 4  // The scores
+#define DELTA_ROUNDS 8  // Some rounds follow
+// Number of clients that can follow one game
+#define MAX_GAME_SUBSCRIBERS 16
+
+// Largest packet the socket transport sends at once, longer messages are split and reassembled by the receiver
+#define SOCKET_MAX_PACKET 65536
+
+// Control codes of the messages. The code travels in the message header, the arguments in the payload.
+typedef enum
+{
+    CMD_NONE = 0,
+    CMD_REGISTER,      // "C"
+    CMD_QUIT,          // "Q"
+    CMD_LEADERBOARD,   // "4L"
+    CMD_NEW_GAME,      // "NG,<num_players>,<num_rounds>"
+    CMD_WAITING_GAMES, // "SW"
+    CMD_JOIN_GAME,     // "JG,<game_id>"
+    CMD_CURRENT_GAMES, // "SG"
+    CMD_GAME_INFO,     // "GI,<game_id>"
+    CMD_MAKE_DECISION, // "MD,<game_id>,<decision>"
+    CMD_SUBSCRIBE,     // "SU,<game_id>"
+    CMD_UNSUBSCRIBE,   // "US"
+    CMD_GAME_DELTA,    // "GD,<game_id>,<version>"
+    CMD_LEADERBOARD_TOP,   // "LT,<count>"
+    CMD_LEADERBOARD_PAGE,  // "LP,<page>,<size>"
+    CMD_LEADERBOARD_RANK,  // "LR,<around>[,<player>]"
+    CMD_LEADERBOARD_COUNT, // "LC"
+    CMD_LOBBY_QUERY,       // "LQ,<count>,<a|f>,<cursor>[,<num_players>,<num_rounds>,<free_seats>]"
+    CMD_COUNT
+} CommandCode;
+
+// Header in front of every message between a client and the server
+typedef struct
+{
+    uint32_t length;         // Number of payload bytes after the header
+    uint16_t command;        // CommandCode
+    uint16_t flags;          // FRAME_FLAG_* bits
+    uint32_t correlation_id; // Chosen by the client for a request and copied to its response
+    char sender[8];          // Client ID of the sender of a request, null terminated
+} FrameHeader;
+
+// Reassembles messages from a byte stream. One read can end in the middle of a message or contain many of them.
+typedef struct
+{
+    char *buffer;
+    size_t length;   // Number of bytes in the buffer
+    size_t capacity; // Allocated size of the buffer
+    size_t consumed; // Number of bytes of messages already handed out
+} FrameReader;
+
+// A string that grows as text is appended to it
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} StringBuilder;
+
 typedef struct
 {
     char name[6]; // Player ID, max 5 characters + null terminator
     int score;    // Player score
     int matches;  // Number of matches played
+    bool registered; // The player registered, a name that only joined a game is not on the leaderboard
 } Player;
 
+// Hash index of the registered players: open addressing with linear probing, keyed by playerKey() of the name.
+// It gives the player ID of a name, which is the position of the player in the players array.
+typedef struct
+{
+    uint64_t *keys; // Key of every entry, 0 if the entry is empty
+    int *ids;       // Player ID of every entry
+    int size;       // Number of entries, a power of two
+} PlayerIndex;
+
+// Node of a registered player in the ranking, a treap ordered by score (highest first) and name. The node of a player
+// is at its player ID. The priorities keep the tree balanced and the sizes give the place of a player.
 typedef struct
 {
-    int id;
+    int left;  // Player ID of the child, -1 if there is none
+    int right;
+    int size;  // Number of players in the subtree
+    uint32_t priority;
+} RankNode;
+
+// The top of the leaderboard and the place of one player, the answer of the LT command
+typedef struct
+{
+    int num_ranked; // Number of players on the leaderboard
+    int my_rank;    // Place of the player from 1, 0 if the player is not on the leaderboard
+    Player me;
+    int count;      // Number of players in top
+    Player top[MAX_LEADERBOARD_TOP];
+} LeaderBoardTop;
+
+// A part of the leaderboard, the answer of the LP and LR commands
+typedef struct
+{
+    int num_ranked; // Number of players on the leaderboard
+    int first_rank; // Place of the first player of the page from 1
+    int my_rank;    // LR: place of the asked player from 1, 0 if the player is not on the leaderboard
+    int count;      // Number of players in players
+    Player players[MAX_LEADERBOARD_PAGE];
+} LeaderBoardPage;
+
+// States of a game. A game goes from waiting to playing when it is full and to finished after the last round.
+typedef enum
+{
+    GAME_WAITING,
+    GAME_PLAYING, // current_round is the round being played
+    GAME_FINISHED
+} GamePhase;
+
+// The memory of a game. Every part of the game is taken from it, and it is emptied in one step when the slot is
+// reused for a new game. The block is kept for the next game of the slot, so a server that keeps playing games
+// stops allocating once its slots have blocks big enough.
+typedef struct
+{
+    char *base;
+    size_t capacity;
+    size_t used;
+} GameArena;
+
+typedef struct
+{
+    pthread_mutex_t lock; // Protects everything else in the game, except the moves (see round_moves)
+    _Atomic int id;       // 0 while the slot is empty
+    int generation;       // Number of times the slot was reused
+    _Atomic int refs;     // Subscriptions and moves in progress using the game, its slot is not reused until it is 0
+    int live_index;       // Position in game_table.live, -1 when the game is retired
+    _Atomic GamePhase phase; // Written under the lock, read without it by makeMove()
     int num_players;
     int num_rounds;
-    int current_round;
+    _Atomic int current_round; // Written under the lock, read without it by makeMove()
     int num_joined_players;
     int num_current_round;
-    char *playerNames[5];
-    int playerScores[5];
     bool started;
     bool active;
-    char *roundData[5];
+    // The parts sized by the number of players and rounds are taken from the arena, see allocateGameRecord()
+    GameArena arena;
+    char (*playerNames)[PLAYER_ID_WIDTH + 1];
+    int *player_ids; // Player IDs of the joined players, the names are only kept to send them
+    int *playerScores;
+    // The moves of a round are words_per_round words of ROUND_WORD_PLAYERS players: 2 bits (a MoveCode) per player and
+    // above ROUND_SUBMITTED_SHIFT the mask of the players who moved. Players set their move with a compare and swap,
+    // without taking the lock, and then count it in round_moved.
+    int words_per_round;
+    _Atomic uint32_t *round_moves;
+    _Atomic int *round_moved;
+    // Every change increments version and stamps the changed part with it, so the changes since a version can be found.
+    // A move only increments version, the current round is always part of a delta.
+    _Atomic uint32_t version;
+    uint32_t state_version;   // started or current_round changed
+    uint32_t players_version; // A player joined
+    uint32_t scores_version;
+    uint32_t *round_versions;
 } Game;
 
-#define FIFO_FILE "/tmp/my_fifo"
-#define FIFO_FILE_RESPONSE "/tmp/my_fifo_response"
+// The games. The slots are allocated GAME_CHUNK_SIZE at a time when they are needed and never freed, so a Game pointer
+// stays valid while the server runs. The slot of a finished game is reused for a new game once nobody uses it.
+// Lock order: table lock before a game lock.
+typedef struct
+{
+    pthread_rwlock_t lock;                         // Protects the rest, the chunks can be read without it
+    Game *_Atomic chunks[MAX_GAMES / GAME_CHUNK_SIZE];
+    int num_slots;                                 // Slots handed out so far, slot 0 is never used
+    int free_slots[MAX_GAMES];                     // Slots of retired games that can be reused
+    int num_free;
+    int live[MAX_GAMES];                           // Slots of the games that are not retired, in no particular order
+    int num_live;
+} GameTable;
 
-#define MAX_PLAYERS 100
-#define MAX_GAMES 100
-#define MAX_THREADS 100
+// Binary codes of the moves, 2 bits each
+typedef enum
+{
+    MOVE_NONE = 0,
+    MOVE_ROCK,
+    MOVE_PAPER,
+    MOVE_SCISSORS
+} MoveCode;
+
+// Number of players in one round word and where the submitted mask of a round word starts, the moves are below it
+#define ROUND_WORD_PLAYERS 8
+#define ROUND_SUBMITTED_SHIFT 16
+
+// The client's copy of a game. Deltas from the server are applied to it.
+typedef struct
+{
+    uint32_t version; // 0 if the client has nothing yet
+    bool started;
+    int num_players;
+    int current_round;
+    int num_rounds;
+    char player_ids[MAX_GAME_PLAYERS][PLAYER_ID_WIDTH + 1];
+    int scores[MAX_GAME_PLAYERS];
+    uint8_t moves[MAX_GAME_ROUNDS][(MAX_GAME_PLAYERS + 3) / 4];
+} GameState;
+
+// A decoded binary game info. It points into the received message, nothing is copied or allocated.
+typedef struct
+{
+    bool started;
+    int num_players;
+    int current_round;
+    int num_rounds;
+    const char *player_ids;     // num_players IDs of PLAYER_ID_WIDTH bytes each
+    int scores[MAX_GAME_PLAYERS];
+    const uint8_t *moves;       // The moves of every round up to current_round, 2 bits per player
+    int round_size;             // Bytes of one round in moves
+} GameInfoView;
+
+// A client's session on the server. The response channel is opened once when the client registers and reused until it disconnects.
+// Responses that cannot be written right away wait in the outbound queue until the channel becomes writable.
+typedef struct
+{
+    char name[6];        // Client ID the channel belongs to, empty until the client registers
+    int response_fd;     // Write end of the client's response FIFO or the client's socket (non-blocking)
+    int watch_events;    // Events the loop always waits for on this channel
+    int ring;            // Response ring of a shared memory client, -1 for the other transports
+    bool active;         // Slot is in use
+    uint32_t generation; // Incremented when the slot is closed, so a late response cannot reach the next client of the slot
+    FrameReader reader;  // Requests received on the client's own channel (socket transport)
+    int subscribed_game; // Game the client gets pushed updates of, 0 if none
+    uint32_t pushed_version; // Version of the subscribed game the client has
+    char *out_buffer;    // Outbound queue
+    size_t out_length;   // Number of queued bytes
+    size_t out_capacity; // Allocated size of the outbound queue
+} Connection;
+
+// Event sources of the server loop
+#define EVENT_READ 1
+#define EVENT_WRITE 2
+#define EVENT_CLOSED 4
+
+// The tag of the request FIFO or listening socket, connections are tagged with their index in the connection table
+#define EVENT_TAG_REQUESTS -1
+// The tag of the pipe other threads use to wake up the loop
+#define EVENT_TAG_WAKE -2
+
+typedef struct
+{
+    int tag;
+    int events;
+} LoopEvent;
+
+// epoll based event loop of the server. Other systems fall back to poll().
+typedef struct
+{
+#ifdef __linux__
+    int epoll_fd;
+#else
+    struct pollfd fds[MAX_CONNECTIONS + 1];
+    int tags[MAX_CONNECTIONS + 1];
+    int num_fds;
+#endif
+    bool running;
+} EventLoop;
+
+// A worker thread that runs games and the games waiting for it
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // Signaled when a game is queued while the worker sleeps
+    int first;            // First and last slot of the run queue, 0 if it is empty
+    int last;
+    bool sleeping;        // The worker waits for ready
+    bool stopping;        // The worker exits when its queue is empty
+} GameWorker;
+
+// The workers and the wakeup state of every game slot. A game is always run by worker slot % num_workers.
+typedef struct
+{
+    GameWorker workers[MAX_THREADS];
+    int num_workers;
+    _Atomic bool scheduled[MAX_GAMES]; // The slot is in the run queue of its worker
+    int next_scheduled[MAX_GAMES];     // The next slot in the same run queue
+    _Atomic unsigned long wakeups;     // Number of times a sleeping worker woke up
+} WorkerPool;
+
+// A deadline of a game: the waiting room closes (round 0) or the players who did not move in the round forfeit it
+typedef struct
+{
+    int game_id;
+    int round;
+} GameDeadline;
+
+// The deadlines of the games in a hierarchical timer wheel, serviced by the server loop.
+// A bucket of level l holds the timers of TIMER_WHEEL_SIZE^l ticks. A timer is put into the lowest level that reaches
+// its expiry, and when the wheel gets to its bucket it is put into a lower level again, until it expires in level 0.
+// Every game slot has at most one timer, linked into its bucket through the slot, so arming and cancelling are O(1).
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint64_t tick; // The next tick to process
+    int count;     // Number of armed timers
+    int heads[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SIZE]; // First slot in every bucket, 0 if it is empty
+    int next[MAX_GAMES];
+    int prev[MAX_GAMES];
+    int bucket[MAX_GAMES]; // Bucket of the slot's timer + 1, 0 if the slot has no timer
+    uint64_t expires[MAX_GAMES];
+    GameDeadline deadlines[MAX_GAMES];
+} TimerWheel;
+
+// The games a player is in that are not finished
+typedef struct
+{
+    int *game_ids;
+    int count;
+    int capacity;
+} PlayerGames;
+
+// The open rooms in one order, a treap whose nodes are the game slots. The key of a room is its place in the order.
+typedef struct
+{
+    int root; // 0 if there are no rooms, slot 0 is never a game
+    int left[MAX_GAMES];
+    int right[MAX_GAMES];
+    uint64_t keys[MAX_GAMES];
+} LobbyOrder;
+
+// Which games every player is in and which waiting rooms can be joined, so SG and SW do not look at every game.
+// It changes with the game locked: when a room opens, a player joins, a room fills up and a game ends.
+// Lock order: its lock is taken after a game lock or players_lock and no other lock is taken while it is held.
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint64_t open[MAX_GAMES / 64];            // Bit of the slot of every waiting room that is not full
+    uint64_t open_words[MAX_GAMES / 64 / 64]; // Bit of every word of open that is not 0
+    int open_ids[MAX_GAMES];                  // Game ID of every open slot
+    int num_open;
+    PlayerGames *players; // Indexed by player ID, it grows when a player joins the first game
+    int players_capacity;
+    // The open rooms in the orders of the lobby
+    LobbyOrder by_age;
+    LobbyOrder by_fill;
+    uint64_t next_room_serial;
+    uint64_t room_serials[MAX_GAMES]; // Order in which the rooms were opened
+    int room_players[MAX_GAMES];
+    int room_rounds[MAX_GAMES];
+    int room_joined[MAX_GAMES];
+} MembershipIndex;
+
+// The orders of the lobby
+typedef enum
+{
+    LOBBY_BY_AGE = 'a',  // The oldest room first
+    LOBBY_BY_FILL = 'f', // The room with the fewest free seats first, then the oldest
+} LobbySort;
 
+// A lobby query: the rooms after cursor in the order, 0 filters match every room
+typedef struct
+{
+    int count;
+    LobbySort sort;
+    uint64_t cursor; // 0 for the first page, then the next_cursor of the page before
+    int num_players;
+    int num_rounds;
+    int min_free; // Rooms with at least this many free seats
+} LobbyQuery;
 
-extern Game games[MAX_GAMES];
-extern int game_num;
+// A waiting room in the answer of LQ
+typedef struct
+{
+    int game_id;
+    int num_joined;
+    int num_players;
+    int num_rounds;
+} LobbyRoom;
 
-extern Player players[MAX_PLAYERS];
+// A page of the lobby, the answer of LQ
+typedef struct
+{
+    uint64_t next_cursor; // 0 if there are no more rooms
+    int count;
+    LobbyRoom rooms[MAX_LOBBY_PAGE];
+} LobbyPage;
+
+struct RequestWorker;
+
+// One request of a client
+typedef struct
+{
+    char client_name[6];
+    CommandCode command;
+    uint32_t correlation_id;
+    uint16_t flags;         // FRAME_FLAG_* bits of the request
+    const char *args;       // Arguments of the command (not null terminated)
+    size_t args_length;
+    Connection *connection; // Channel the response goes to, NULL if the client has none yet
+    uint32_t generation;    // Generation of the connection when the request arrived
+    struct RequestWorker *worker; // Request worker running the request, NULL on the server loop
+} Request;
+
+// A request or a response waiting in a queue between the server loop and a request worker.
+// The arguments of the request or the payload of the response follow it in the queue.
+typedef struct
+{
+    Request request;     // For a response: the request it answers
+    bool response;       // A response to send, otherwise a request to run
+    uint16_t flags;      // FRAME_FLAG_* bits of the response
+    size_t length;       // Number of bytes after the message
+} QueuedMessage;
+
+// A thread that runs requests. All requests of a client go to the same worker, so they are answered in order.
+typedef struct RequestWorker
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;   // Signaled when a request is queued while the worker sleeps
+    StringBuilder incoming; // Requests from the server loop
+    StringBuilder outbox;   // Responses and requests for the server loop
+    bool sleeping;
+    bool stopping;
+} RequestWorker;
+
+// The request workers. Without workers the server loop runs the requests itself.
+typedef struct
+{
+    RequestWorker workers[MAX_THREADS];
+    int num_workers;
+    _Atomic unsigned long handled; // Number of requests the workers finished
+} RequestStage;
+
+// A piece of a string that is not null terminated
+typedef struct
+{
+    const char *data;
+    size_t length;
+} Span;
+
+// The arguments a command takes
+typedef enum
+{
+    ARGS_NONE,         // No arguments
+    ARGS_GAME,         // <game_id>
+    ARGS_NEW_GAME,     // <num_players>,<num_rounds>
+    ARGS_DECISION,     // <game_id>,<r|p|s>
+    ARGS_GAME_VERSION, // <game_id>,<version>
+    ARGS_TOP,          // <count>
+    ARGS_PAGE,         // <page>,<size>
+    ARGS_RANK,         // <around>[,<player>]
+    ARGS_LOBBY,        // <count>,<a|f>,<cursor>[,<num_players>,<num_rounds>,<free_seats>]
+} ArgumentKind;
+
+// The parsed and checked arguments of a command
+typedef struct
+{
+    int game_id;
+    int num_players;
+    int num_rounds;
+    uint32_t version;
+    char decision;
+    int top;
+    int page;
+    int page_size;
+    int around;
+    char player[PLAYER_ID_WIDTH + 1]; // Empty for the client itself
+    LobbyQuery lobby;
+} CommandArgs;
+
+typedef void (*CommandHandler)(Request *request, const CommandArgs *args);
+
+// One entry of the command table
+typedef struct
+{
+    const char *code; // Control code as the client writes it
+    ArgumentKind arguments;
+    CommandHandler handler;
+    bool on_loop;     // The command opens, closes or subscribes connections, so it always runs on the server loop
+} CommandSpec;
+
+// One request in the shared memory request ring
+typedef struct
+{
+    _Atomic uint32_t sequence; // Position the slot is ready for, set by the producer when the request is written
+    uint16_t ring;             // Response ring of the sender
+    uint16_t length;
+    uint32_t generation;       // Generation of the response ring when the sender claimed it
+    char data[SHM_SLOT_SIZE - 12];
+} ShmRequestSlot;
+
+// Multi-producer single-consumer ring all clients write their requests into.
+// The consumer sleeps on the futex word, producers only wake it when the ring goes from empty to non-empty.
+typedef struct
+{
+    _Atomic uint32_t tail;  // Next position a producer claims
+    char tail_padding[60];  // Keep producers and the consumer on different cache lines
+    _Atomic uint32_t head;  // Next position the consumer reads
+    _Atomic uint32_t futex; // Incremented on every empty to non-empty change
+    char head_padding[56];
+    ShmRequestSlot slots[SHM_REQUEST_SLOTS];
+} ShmRequestRing;
+
+// Single-producer single-consumer byte ring carrying the responses of one client
+typedef struct
+{
+    _Atomic uint32_t owner;      // Process ID of the client using the ring, 0 if free
+    _Atomic uint32_t generation; // Incremented every time a client claims the ring
+    char owner_padding[56];
+    _Atomic uint32_t tail;       // Written by the server
+    char tail_padding[60];
+    _Atomic uint32_t head;       // Read position of the client
+    _Atomic uint32_t futex;      // Incremented on every empty to non-empty change
+    char head_padding[56];
+    char data[SHM_RESPONSE_RING_SIZE];
+} ShmResponseRing;
+
+// Layout of the shared memory segment
+typedef struct
+{
+    _Atomic uint32_t server_pid; // The clients notice a dead server with this
+    ShmRequestRing requests;
+    ShmResponseRing responses[SHM_MAX_CLIENTS];
+} ShmSegment;
+
+// A way of carrying messages between the clients and the server. The server side is driven by the event loop.
+typedef struct
+{
+    const char *name;
+    bool (*serverListen)(void);                                     // Create the endpoint the clients connect to
+    void (*serverRequestsReady)(void);                              // The endpoint has new requests or clients
+    Connection *(*serverOpen)(Connection *connection, const char *client_name); // Set up the response channel on registration
+    void (*serverRead)(Connection *connection);                     // A client's own channel has requests (NULL if unused)
+    ssize_t (*serverWrite)(Connection *connection, const char *data, size_t length);
+    void (*serverClose)(Connection *connection);                    // Extra cleanup when a connection is closed (NULL if none)
+    void (*serverRun)(void);                                        // Own server loop instead of the event loop (NULL if unused)
+    void (*serverWake)(void);                                       // Wake up serverRun from another thread (NULL if unused)
+    bool (*clientConnect)(void);
+    bool (*clientSend)(const char *message, size_t length);
+    ssize_t (*clientReceive)(char *buffer, size_t size, int timeout_ms); // Returns 0 if the server is gone, -1 with EAGAIN on timeout (-1 waits forever)
+} Transport;
+
+// The clients following one game. Only the server loop uses it.
+typedef struct
+{
+    Connection *connections[MAX_GAME_SUBSCRIBERS];
+    int count;
+} GameSubscribers;
+
+// The server's end of the main request FIFO. It is opened once and drained in batches.
+typedef struct
+{
+    int fd;             // Read end of FIFO_FILE
+    int keepalive_fd;   // Write end held by the server so the FIFO does not reach end of file between clients
+    FrameReader frames; // Data read from the FIFO that is not handled yet
+} RequestReader;
+
+extern GameTable game_table;
+
+extern Player *players;
 extern int num_players;
+extern int num_registered;
+extern int players_capacity;
+extern PlayerIndex player_index;
+extern RankNode *rank_nodes;
+extern int rank_root;
 
 extern pthread_t thread_ids[MAX_THREADS];
 extern int num_threads;
+extern int num_game_workers;
+extern int num_request_workers;
+extern int round_timeout;
+extern int lobby_timeout;
+extern TimerWheel timer_wheel;
+extern MembershipIndex membership;
+
+extern const CommandSpec command_table[CMD_COUNT];
+
+extern Connection connections[MAX_CONNECTIONS];
+extern GameSubscribers subscribers[MAX_GAMES];
+extern int wake_fds[2];
+extern EventLoop server_loop;
 
-extern pthread_mutex_t lock;
-extern pthread_cond_t cond;
+extern const Transport fifo_transport;
+extern const Transport socket_transport;
+extern const Transport shm_transport;
+extern const Transport *transport;
+
+// Lock order: Game.lock before players_lock. Never take a game lock while holding players_lock.
+extern pthread_rwlock_t players_lock;
+extern WorkerPool worker_pool;
+extern RequestStage request_stage;
 
 
 void setupForThreads(void);
@@ -62,15 +697,236 @@ void endThreads(void);
 
 void handle_server_sigterm(int sig);
 void handle_server_sigint(int sig);
-void *startGameServer(void *arg);
+void scoreRound(Game *game, int round);
+void countRoundMoves(uint32_t moves, int count[4]);
+bool advanceGame(Game *game);
+void finishGame(Game *game);
+void stepGame(int game_id);
 void createNewGameServer(int num_players, int num_rounds);
+int takeGameSlot(void);
+Game *gameAtSlot(int slot);
+int gameSlot(int game_id);
+Game *getGame(int game_id);
+Game *lockGame(int game_id);
+Game *acquireGame(int game_id);
+void releaseGame(Game *game);
+void retireGame(int game_id);
+void resetGames(void);
+bool arenaReset(GameArena *arena, size_t size);
+void *arenaAlloc(GameArena *arena, size_t size);
+void arenaRelease(GameArena *arena);
+bool allocateGameRecord(Game *game, int num_players, int num_rounds);
+void freeGameRecord(Game *game);
+void scheduleGame(int game_id);
+uint64_t monotonicMs(void);
+uint64_t timerNow(void);
+void linkTimer(int slot);
+void unlinkTimer(int slot);
+void armGameTimer(int game_id, int round, uint64_t expires);
+void cancelGameTimer(int game_id);
+void setGameDeadline(Game *game);
+int advanceTimers(uint64_t now, GameDeadline expired[]);
+int timerTimeout(void);
+int expireTimers(uint64_t now);
+void expireGameDeadline(GameDeadline deadline);
+void resetTimers(void);
+void *gameWorker(void *arg);
+bool startWorkers(int count);
+void stopWorkers(void);
+int defaultWorkerCount(void);
 char *getGameInfo(int game_id);
+size_t getGameInfoBinary(int game_id, uint8_t *buffer);
+size_t getGameDeltaBinary(int game_id, uint32_t since, uint8_t *buffer, uint32_t *version);
+void touchGame(Game *game, uint32_t *part);
 bool registerClient(char *client_name);
 char *getLeaderBoard(void);
 bool joinGame(int game_id, char *playerName);
+bool isJoined(const Game *game, int player_id);
+void openRoom(const Game *game);
+void closeRoom(const Game *game);
+bool addMembership(int player_id, int game_id);
+void removeMembership(int player_id, int game_id);
+void closeGameMembership(const Game *game);
+void resetMembership(void);
+void markJoinedRooms(int player_id, uint64_t joined[MAX_GAMES / 64]);
+uint64_t roomKey(int slot, LobbySort sort);
+uint32_t roomPriority(int slot);
+void splitLobby(LobbyOrder *order, int node, uint64_t key, int *before, int *after);
+int mergeLobby(LobbyOrder *order, int before, int after);
+int removeFirstRoom(LobbyOrder *order, int node);
+void insertRoom(LobbyOrder *order, int slot, uint64_t key);
+void removeRoom(LobbyOrder *order, int slot);
+void fillRoom(const Game *game);
+bool walkLobby(const LobbyOrder *order, int node, const LobbyQuery *query, const uint64_t joined[], LobbyPage *page, int *scanned);
+bool roomAfter(const LobbyOrder *order, uint64_t key);
+void queryLobby(const char *client_name, const LobbyQuery *query, LobbyPage *page);
+int findWaitingGames(const char *client_name, int game_ids[]);
+int findPlayerGames(const char *client_name, int game_ids[]);
+char *formatGameList(const int game_ids[], int count);
 char *listWaitingGames(char *client_name);
 char *listGames(char *client_name);
 void makeDecision(char *game_id_string, char *decision_string, char *client_name);
+void makeMove(int game_id, char decision, const char *client_name);
+
+Connection *findConnection(const char *client_name);
+Connection *allocateConnection(int fd, int watch_events);
+void bindConnection(Connection *connection, const char *client_name);
+void closeConnection(Connection *connection);
+bool sendFrame(Connection *connection, CommandCode command, uint32_t correlation_id, uint16_t flags, const char *payload, size_t length);
+bool sendResponse(Request *request, uint16_t flags, const char *payload, size_t length);
+bool flushConnection(Connection *connection);
+
+void notifyGameChanged(int game_id);
+void wakeServerLoop(void);
+size_t encodeGameUpdate(int game_id, uint32_t since, uint8_t *buffer, uint32_t *version);
+bool subscribeGame(Connection *connection, int game_id);
+void unsubscribeGame(Connection *connection);
+void publishGameUpdates(void);
+
+CommandCode findCommandCode(const char *control, size_t length);
+size_t encodeFrame(char *buffer, CommandCode command, uint32_t correlation_id, uint16_t flags, const char *sender, const char *payload, size_t length);
+bool decodeFrame(const char *data, size_t length, FrameHeader *header, const char **payload);
+char *frameReaderReserve(FrameReader *reader, size_t size);
+void frameReaderCommit(FrameReader *reader, size_t length);
+int frameReaderNext(FrameReader *reader, FrameHeader *header, const char **payload);
+void frameReaderFree(FrameReader *reader);
+bool builderAppend(StringBuilder *builder, const char *data, size_t length);
+bool builderPrintf(StringBuilder *builder, const char *format, ...);
+
+size_t putVarint(uint8_t *buffer, uint32_t value);
+bool getVarint(const uint8_t **cursor, const uint8_t *end, uint32_t *value);
+size_t putVarint64(uint8_t *buffer, uint64_t value);
+bool getVarint64(const uint8_t **cursor, const uint8_t *end, uint64_t *value);
+bool builderAppendVarint(StringBuilder *builder, uint32_t value);
+MoveCode moveCode(char decision);
+char moveChar(MoveCode move);
+MoveCode roundMove(uint32_t moves, int player);
+uint32_t roundSubmitted(uint32_t moves);
+uint32_t packRoundMoves(const char *decisions);
+bool submitMove(Game *game, int round, int player, MoveCode move);
+_Atomic uint32_t *roundWord(const Game *game, int round, int player);
+MoveCode gameMove(const Game *game, int round, int player);
+int playedRounds(int current_round, int num_rounds);
+uint64_t playerKey(const char *client_name);
+uint32_t playerHash(uint64_t key);
+int internPlayer(uint64_t key, const char *client_name);
+int lookupPlayer(uint64_t key);
+int playerId(const char *client_name);
+bool growPlayers(void);
+void resetPlayers(void);
+bool rankedBefore(int a, int b);
+void updateRankSize(int node);
+void splitRanking(int node, int player_id, int *before, int *after);
+int mergeRanking(int before, int after);
+int removeFirstRanked(int node);
+void rankPlayer(int player_id);
+void unrankPlayer(int player_id);
+void addPlayerPoints(int player_id, int points);
+int playerRank(int player_id);
+int rankedPlayer(int rank);
+void collectRanked(int node, int offset, int first, int last, Player ranked[], int *count);
+void getLeaderBoardTop(const char *client_name, int count, LeaderBoardTop *top);
+void getLeaderBoardPage(long first, int count, LeaderBoardPage *page);
+void getLeaderBoardAround(const char *name, int around, LeaderBoardPage *page);
+int leaderBoardCount(void);
+size_t encodeLeaderBoardTop(const LeaderBoardTop *top, uint8_t *buffer);
+bool decodeLeaderBoardTop(const uint8_t *data, size_t length, LeaderBoardTop *top);
+size_t encodeLeaderBoardPage(const LeaderBoardPage *page, uint8_t *buffer);
+bool decodeLeaderBoardPage(const uint8_t *data, size_t length, LeaderBoardPage *page);
+size_t encodeLobbyPage(const LobbyPage *page, uint8_t *buffer);
+bool decodeLobbyPage(const uint8_t *data, size_t length, LobbyPage *page);
+int findPlayer(const Game *game, int player_id);
+size_t encodeGameInfo(const Game *game, uint8_t *buffer);
+bool decodeGameInfo(const uint8_t *data, size_t length, GameInfoView *view);
+size_t encodeGameDelta(const Game *game, uint32_t since, uint8_t *buffer);
+bool roundChanged(const Game *game, int round, uint32_t since);
+bool applyGameDelta(GameState *state, const uint8_t *data, size_t length);
+char gameStateMove(const GameState *state, int round, int player);
+char gameInfoMove(const GameInfoView *view, int round, int player);
+void gameInfoPlayer(const GameInfoView *view, int player, char name[PLAYER_ID_WIDTH + 1]);
+bool encodeGameList(StringBuilder *builder, const int game_ids[], int count);
+int decodeGameList(const uint8_t *data, size_t length, int game_ids[], int max_games);
+bool encodeLeaderBoard(StringBuilder *builder);
+int decodeLeaderBoard(const uint8_t *data, size_t length, Player players[], int max_players);
+
+const Transport *findTransport(const char *name);
+bool parseRequest(const FrameHeader *header, const char *payload, Request *request);
+void dispatchBatch(Request batch[], int count);
+void sendGameList(Request *request, const int game_ids[], int count);
+void handleRequest(Request *request);
+
+unsigned int clientHash(const char *client_name);
+bool queueMessage(StringBuilder *queue, const Request *request, bool response, uint16_t flags, const char *data, size_t length);
+const QueuedMessage *nextQueuedMessage(const StringBuilder *queue, size_t *offset, const char **data);
+void submitRequest(Request *request);
+void *requestWorker(void *arg);
+bool startRequestWorkers(int count);
+void stopRequestWorkers(void);
+void drainRequestOutboxes(void);
+
+bool nextToken(Span *rest, char separator, Span *token);
+bool spanToInt(Span token, long min, long max, long *value);
+bool parseArguments(ArgumentKind kind, Span rest, CommandArgs *args);
+void handleRegister(Request *request, const CommandArgs *args);
+void handleQuit(Request *request, const CommandArgs *args);
+void handleLeaderboard(Request *request, const CommandArgs *args);
+void handleNewGame(Request *request, const CommandArgs *args);
+void handleWaitingGames(Request *request, const CommandArgs *args);
+void handleJoinGame(Request *request, const CommandArgs *args);
+void handleCurrentGames(Request *request, const CommandArgs *args);
+void handleGameInfo(Request *request, const CommandArgs *args);
+void handleMakeDecision(Request *request, const CommandArgs *args);
+void handleSubscribe(Request *request, const CommandArgs *args);
+void handleUnsubscribe(Request *request, const CommandArgs *args);
+void handleGameDelta(Request *request, const CommandArgs *args);
+void handleLeaderboardTop(Request *request, const CommandArgs *args);
+void sendLeaderBoardPage(Request *request, const LeaderBoardPage *page);
+void handleLeaderboardPage(Request *request, const CommandArgs *args);
+void handleLeaderboardRank(Request *request, const CommandArgs *args);
+void handleLeaderboardCount(Request *request, const CommandArgs *args);
+void handleLobbyQuery(Request *request, const CommandArgs *args);
+
+bool openRequestReader(RequestReader *reader);
+int readRequestBatch(RequestReader *reader, Request batch[], int max_batch);
+bool fifoServerListen(void);
+void fifoServerRequestsReady(void);
+Connection *fifoServerOpen(Connection *connection, const char *client_name);
+ssize_t fifoServerWrite(Connection *connection, const char *data, size_t length);
+void fifoServerClose(Connection *connection);
+bool fifoClientConnect(void);
+bool fifoClientSend(const char *message, size_t length);
+ssize_t fifoClientReceive(char *buffer, size_t size, int timeout_ms);
+
+bool socketServerListen(void);
+void socketServerRequestsReady(void);
+Connection *socketServerOpen(Connection *connection, const char *client_name);
+void socketServerRead(Connection *connection);
+ssize_t socketServerWrite(Connection *connection, const char *data, size_t length);
+bool socketClientConnect(void);
+bool socketClientSend(const char *message, size_t length);
+ssize_t socketClientReceive(char *buffer, size_t size, int timeout_ms);
+
+void futexWait(_Atomic uint32_t *address, uint32_t value, int timeout_ms);
+void futexWake(_Atomic uint32_t *address);
+void shmInitSegment(ShmSegment *segment);
+bool shmRequestPush(ShmRequestRing *ring, uint16_t response_ring, uint32_t generation, const char *data, size_t length);
+bool shmRequestPop(ShmRequestRing *ring, ShmRequestSlot *request);
+size_t shmResponseWrite(ShmResponseRing *ring, const char *data, size_t length);
+size_t shmResponseRead(ShmResponseRing *ring, char *buffer, size_t size);
+bool shmServerListen(void);
+void shmServerRun(void);
+void shmServerWake(void);
+Connection *shmServerOpen(Connection *connection, const char *client_name);
+ssize_t shmServerWrite(Connection *connection, const char *data, size_t length);
+void shmServerClose(Connection *connection);
+bool shmClientConnect(void);
+bool shmClientSend(const char *message, size_t length);
+ssize_t shmClientReceive(char *buffer, size_t size, int timeout_ms);
+
+bool eventLoopInit(EventLoop *loop);
+void eventLoopWatch(EventLoop *loop, int fd, int events, int tag);
+void eventLoopUnwatch(EventLoop *loop, int fd);
+int eventLoopWait(EventLoop *loop, LoopEvent events[], int max_events, int timeout_ms);
 
 void server(void);
 
@@ -82,14 +938,29 @@ void handle_client_sigterm(int sig);
 
 void showMenu(void);
 void displayWaitingRooms(bool prevJoined, int prevJoinedId, bool cantjoin);
+void drawWaitingRooms(LobbySort sort, uint64_t cursor, LobbyPage *page, bool prevJoined, int prevJoinedId, bool cantjoin);
 void displayGame(int game_id);
+void followGame(int game_id);
+bool applyGameUpdate(int game_id, const char *message, size_t length);
+bool drawGame(int game_id);
+void drawGameTable(const GameState *game, int num_rounds);
+void leaveGame(void);
+bool redrawGame(int game_id);
 void showCurrentGames(void);
 void createNewGame(void);
+int readNumber(int min, int max);
 void showLeaderboard(void);
-int compare(const void *a, const void *b);
-void printLeaderboard(Player players[], int size, char *currentPlayer);
-void parseMessage(char *message, char *currentPlayer);
+void printLeaderboard(const LeaderBoardTop *top, const char *currentPlayer);
+void showLeaderboardPage(const char *command, LeaderBoardPage *page);
+void printLeaderboardPage(const LeaderBoardPage *page, const char *currentPlayer);
 
+void openResponseChannel(void);
+bool waitReadable(int fd, int timeout_ms);
+bool receiveFromServer(int timeout_ms);
+bool nextFromServer(FrameHeader *header, const char **payload);
+char *readResponse(FrameHeader *header);
+char *takeGameUpdate(size_t *length);
+int waitForKey(void);
 char *readFromServer(void);
 void client(const char *id);
 
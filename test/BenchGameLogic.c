@@ -0,0 +1,557 @@
+// Benchmarks of the server side game logic. They are not unit tests, they print numbers to compare.
+// Build: gcc -O2 -Isrc -o BenchGameLogic test/BenchGameLogic.c src/gameLogic.c -lncurses -lpthread
+// Run:   ./BenchGameLogic [wakeups|requests|scoring|soak|timers|players|leaderboard|lists|lobby]
+#include "gameLogic.h"
+#include <time.h>
+
+// Number of rounds of the games the benchmarks play
+#define BENCH_ROUNDS 5
+
+// Current time in nanoseconds
+long long benchNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Start from an empty server
+void benchReset(void)
+{
+    resetPlayers();
+    resetGames();
+    setupForThreads();
+}
+
+// Wait until every game is in the given round (or finished after the last round)
+void benchWaitForRound(int num_games, int round)
+{
+    while (true)
+    {
+        int behind = 0;
+        for (int i = 1; i <= num_games; i++)
+        {
+            Game *game = lockGame(i);
+            if (game->current_round < round || game->phase == GAME_WAITING)
+            {
+                behind++;
+            }
+            pthread_mutex_unlock(&game->lock);
+        }
+        if (behind == 0)
+        {
+            return;
+        }
+        usleep(100);
+    }
+}
+
+// Play every round of num_games games at the same time and count how many times a worker wakes up per move.
+// With one thread per game and a global condition variable every move woke up every game thread,
+// so this number grew with the number of games.
+void benchWakeups(int num_games, int num_workers)
+{
+    benchReset();
+    char name1[] = "foo", name2[] = "bar";
+    registerClient(name1);
+    registerClient(name2);
+    startWorkers(num_workers);
+    for (int i = 1; i <= num_games; i++)
+    {
+        createNewGameServer(2, BENCH_ROUNDS);
+        joinGame(i, name1);
+        joinGame(i, name2);
+    }
+    benchWaitForRound(num_games, 1);
+
+    atomic_store(&worker_pool.wakeups, 0);
+    long long start = benchNow();
+    for (int round = 1; round <= BENCH_ROUNDS; round++)
+    {
+        for (int i = 1; i <= num_games; i++)
+        {
+            makeMove(i, 'r', name1);
+            makeMove(i, 's', name2);
+        }
+        benchWaitForRound(num_games, round + 1);
+    }
+    long long elapsed = benchNow() - start;
+    unsigned long wakeups = atomic_load(&worker_pool.wakeups);
+    stopWorkers();
+
+    long moves = (long)num_games * 2 * BENCH_ROUNDS;
+    printf("%6d games %3d workers: %8ld moves %8lu wakeups %6.3f wakeups/move %8.1f ns/move\n",
+           num_games, num_workers, moves, wakeups, (double)wakeups / moves, (double)elapsed / moves);
+}
+
+// Send the same requests from many clients through the request workers and measure the requests per second.
+// The calling thread plays the server loop: it submits the requests and sends the responses of the workers.
+// The responses are written to /dev/null, so the numbers show the cost of running the requests, not of the channels.
+void benchRequests(CommandCode command, const char *args, int num_workers)
+{
+    enum
+    {
+        NUM_CLIENTS = 64,
+        NUM_REQUESTS = 200000,
+        CHUNK = 256
+    };
+    Connection *clients[NUM_CLIENTS];
+    for (int i = 0; i < NUM_CLIENTS; i++)
+    {
+        char name[6];
+        snprintf(name, sizeof(name), "c%d", i);
+        clients[i] = allocateConnection(open("/dev/null", O_WRONLY), 0);
+        bindConnection(clients[i], name);
+    }
+    startRequestWorkers(num_workers);
+
+    long long start = benchNow();
+    for (int sent = 0; sent < NUM_REQUESTS; sent += CHUNK)
+    {
+        for (int i = sent; i < sent + CHUNK; i++)
+        {
+            Request request;
+            memset(&request, 0, sizeof(request));
+            Connection *client = clients[i % NUM_CLIENTS];
+            strcpy(request.client_name, client->name);
+            request.connection = client;
+            request.command = command;
+            request.flags = FRAME_FLAG_BINARY;
+            request.args = args;
+            request.args_length = strlen(args);
+            request.correlation_id = (uint32_t)i;
+            submitRequest(&request);
+        }
+        drainRequestOutboxes();
+    }
+    while (num_workers > 0 && atomic_load(&request_stage.handled) < NUM_REQUESTS)
+    {
+        drainRequestOutboxes();
+        usleep(10);
+    }
+    drainRequestOutboxes();
+    long long elapsed = benchNow() - start;
+    stopRequestWorkers();
+    for (int i = 0; i < NUM_CLIENTS; i++)
+    {
+        closeConnection(clients[i]);
+    }
+    printf("%-3s %2d workers: %10.0f requests/s\n", command_table[command].code, num_workers, NUM_REQUESTS * 1e9 / elapsed);
+}
+
+// The scoring loop the server used before the rounds were packed: every pair of players is compared
+void benchScorePairs(const char *round, int num_players, int scores[])
+{
+    for (int i = 0; i < num_players; i++)
+    {
+        for (int j = 0; j < num_players; j++)
+        {
+            if (i != j)
+            {
+                if (round[i] == 'p' && round[j] == 'r')
+                {
+                    scores[i]++;
+                }
+                if (round[i] == 'r' && round[j] == 's')
+                {
+                    scores[i]++;
+                }
+                if (round[i] == 's' && round[j] == 'p')
+                {
+                    scores[i]++;
+                }
+            }
+        }
+    }
+}
+
+// Score the same random rounds of full games with the pairwise loop and with scoreRound(), which counts the moves.
+// The sums of the scores have to be the same, they are printed so the compiler cannot drop the work.
+void benchScoring(int num_players)
+{
+    // About the same number of moves for every game size
+    int num_rounds = (1 << 22) / num_players;
+    char *texts = malloc((size_t)num_rounds * (size_t)num_players);
+    Game game;
+    memset(&game, 0, sizeof(game));
+    allocateGameRecord(&game, num_players, num_rounds);
+    srand(1);
+    for (int round = 0; round < num_rounds; round++)
+    {
+        for (int i = 0; i < num_players; i++)
+        {
+            int move = rand() % 3;
+            texts[(size_t)round * num_players + i] = "rps"[move];
+            submitMove(&game, round, i, (MoveCode)(MOVE_ROCK + move));
+        }
+    }
+
+    int scores[MAX_GAME_PLAYERS] = {0};
+    long long start = benchNow();
+    for (int round = 0; round < num_rounds; round++)
+    {
+        benchScorePairs(texts + (size_t)round * num_players, num_players, scores);
+    }
+    long long pairs_elapsed = benchNow() - start;
+    start = benchNow();
+    for (int round = 0; round < num_rounds; round++)
+    {
+        scoreRound(&game, round);
+    }
+    long long counts_elapsed = benchNow() - start;
+
+    long long pairs_sum = 0, counts_sum = 0;
+    for (int i = 0; i < num_players; i++)
+    {
+        pairs_sum += scores[i];
+        counts_sum += game.playerScores[i];
+    }
+    printf("%4d players: pairwise loop %10.1f ns/round, move counts %8.1f ns/round (sums of scores %lld %lld)\n", num_players,
+           (double)pairs_elapsed / num_rounds, (double)counts_elapsed / num_rounds, pairs_sum, counts_sum);
+    freeGameRecord(&game);
+    free(texts);
+}
+
+// Resident memory of the process in kilobytes
+long benchResidentKb(void)
+{
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file != NULL)
+    {
+        if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(file);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Play num_games games of different sizes, BATCH at a time, and print the resident memory as it goes.
+// The finished games give their slots to the next batch, which reuses their arenas, so the memory stays flat.
+void benchSoak(int num_games)
+{
+    enum
+    {
+        BATCH = 1000,
+        SOAK_PLAYERS = 16
+    };
+    benchReset();
+    char names[SOAK_PLAYERS][PLAYER_ID_WIDTH + 1];
+    for (int i = 0; i < SOAK_PLAYERS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "p%d", i);
+        registerClient(names[i]);
+    }
+    // Not joined to anything, so it sees every waiting game
+    char watcher[] = "w";
+    int game_ids[MAX_GAMES];
+    srand(1);
+    long start_kb = 0;
+    long long start = benchNow();
+    for (int played = 0; played < num_games; played += BATCH)
+    {
+        int sizes[BATCH], rounds[BATCH];
+        for (int i = 0; i < BATCH; i++)
+        {
+            sizes[i] = 2 + rand() % (SOAK_PLAYERS - 1);
+            rounds[i] = 3 + rand() % 8;
+            createNewGameServer(sizes[i], rounds[i]);
+        }
+        // The games are listed in no particular order, so the sizes are read from the games
+        int count = findWaitingGames(watcher, game_ids);
+        for (int i = 0; i < count; i++)
+        {
+            Game *game = getGame(game_ids[i]);
+            int num_players = game->num_players, num_rounds = game->num_rounds;
+            for (int j = 0; j < num_players; j++)
+            {
+                joinGame(game_ids[i], names[j]);
+            }
+            for (int round = 0; round < num_rounds; round++)
+            {
+                for (int j = 0; j < num_players; j++)
+                {
+                    makeMove(game_ids[i], "rps"[(round + j) % 3], names[j]);
+                }
+            }
+        }
+        if (played == 0)
+        {
+            start_kb = benchResidentKb();
+        }
+        if ((played + BATCH) % (num_games / 10) == 0)
+        {
+            printf("%8d games: %6ld kB resident (%+ld kB since the first batch), %d slots\n", played + BATCH, benchResidentKb(),
+                   benchResidentKb() - start_kb, game_table.num_slots - 1);
+        }
+    }
+    long long elapsed = benchNow() - start;
+    printf("%.0f games/s\n", num_games * 1e9 / elapsed);
+}
+
+// Arm, re-arm and cancel num_timers round deadlines up to an hour away, then turn the wheel through all of them.
+// The cost per timer should not depend on how many timers there are.
+void benchTimers(int num_timers)
+{
+    resetTimers();
+    GameDeadline *expired = malloc(sizeof(GameDeadline) * MAX_GAMES);
+    uint64_t now = timerNow();
+    srand(1);
+    long long start = benchNow();
+    for (int i = 1; i <= num_timers; i++)
+    {
+        armGameTimer(i, 1, now + 1 + rand() % 36000);
+    }
+    long long arm_elapsed = benchNow() - start;
+    start = benchNow();
+    for (int i = 1; i <= num_timers; i++)
+    {
+        armGameTimer(i, 2, now + 1 + rand() % 36000);
+    }
+    long long rearm_elapsed = benchNow() - start;
+    start = benchNow();
+    int fired = 0;
+    for (uint64_t tick = now; tick <= now + 36000; tick++)
+    {
+        fired += advanceTimers(tick, expired);
+    }
+    long long advance_elapsed = benchNow() - start;
+    for (int i = 1; i <= num_timers; i++)
+    {
+        armGameTimer(i, 1, now + 1 + rand() % 36000);
+    }
+    start = benchNow();
+    for (int i = 1; i <= num_timers; i++)
+    {
+        cancelGameTimer(i);
+    }
+    long long cancel_elapsed = benchNow() - start;
+    printf("%6d timers: arm %6.1f ns, re-arm %6.1f ns, cancel %6.1f ns, an hour of ticks %8.1f us (%d expired)\n", num_timers,
+           (double)arm_elapsed / num_timers, (double)rearm_elapsed / num_timers, (double)cancel_elapsed / num_timers,
+           advance_elapsed / 1000.0, fired);
+    free(expired);
+}
+
+// Register num_players players and look every one of them up by name. With the hash index both take about the same
+// time per player for any number of players, the old array was scanned with strcmp for every registration.
+void benchPlayers(int num_players_to_add)
+{
+    resetPlayers();
+    char name[PLAYER_ID_WIDTH + 1];
+    long long start = benchNow();
+    for (int i = 0; i < num_players_to_add; i++)
+    {
+        snprintf(name, sizeof(name), "%x", i);
+        registerClient(name);
+    }
+    long long register_elapsed = benchNow() - start;
+    long long found = 0;
+    start = benchNow();
+    for (int i = 0; i < num_players_to_add; i++)
+    {
+        snprintf(name, sizeof(name), "%x", i);
+        found += playerId(name) >= 0;
+    }
+    long long lookup_elapsed = benchNow() - start;
+    printf("%7d players: register %6.1f ns, look up %6.1f ns (%lld found)\n", num_players_to_add,
+           (double)register_elapsed / num_players_to_add, (double)lookup_elapsed / num_players_to_add, found);
+}
+
+// Give points to num_players registered players, ask for the top 3 and the place of a player and for pages of 100
+// players. These take O(log n) and O(log n + 100), the client used to get and sort the whole leaderboard for this.
+void benchLeaderboard(int num_players_to_add)
+{
+    resetPlayers();
+    char name[PLAYER_ID_WIDTH + 1];
+    for (int i = 0; i < num_players_to_add; i++)
+    {
+        snprintf(name, sizeof(name), "%x", i);
+        registerClient(name);
+    }
+    int num_updates = 1000000;
+    srand(1);
+    long long start = benchNow();
+    for (int i = 0; i < num_updates; i++)
+    {
+        addPlayerPoints(rand() % num_players_to_add, 1 + rand() % 4);
+    }
+    long long update_elapsed = benchNow() - start;
+    LeaderBoardTop top;
+    long long ranks = 0;
+    start = benchNow();
+    for (int i = 0; i < num_updates; i++)
+    {
+        snprintf(name, sizeof(name), "%x", rand() % num_players_to_add);
+        getLeaderBoardTop(name, 3, &top);
+        ranks += top.my_rank;
+    }
+    long long query_elapsed = benchNow() - start;
+    LeaderBoardPage page;
+    int num_pages = num_updates / 100;
+    long long paged = 0;
+    start = benchNow();
+    for (int i = 0; i < num_pages; i++)
+    {
+        getLeaderBoardPage(rand() % num_players_to_add, 100, &page);
+        paged += page.count;
+    }
+    long long page_elapsed = benchNow() - start;
+    printf("%7d players: add points %6.1f ns, top 3 and rank %6.1f ns, page of 100 %7.1f ns (average rank %lld, %lld paged)\n",
+           num_players_to_add, (double)update_elapsed / num_updates, (double)query_elapsed / num_updates,
+           (double)page_elapsed / num_pages, ranks / num_updates, paged);
+}
+
+// num_rooms waiting rooms and a player in 5 of them: list the rooms the player can join (SW) and the games of the
+// player (SG). SW reads the open rooms 64 at a time and SG only the games of the player, no game is locked.
+void benchGameLists(int num_rooms)
+{
+    benchReset();
+    char name[] = "foo";
+    registerClient(name);
+    for (int i = 0; i < num_rooms; i++)
+    {
+        createNewGameServer(2, BENCH_ROUNDS);
+    }
+    for (int i = 1; i <= 5; i++)
+    {
+        joinGame(i * (num_rooms / 5), name);
+    }
+    int *game_ids = malloc(sizeof(int) * MAX_GAMES);
+    int num_queries = 10000;
+    long long listed = 0;
+    long long start = benchNow();
+    for (int i = 0; i < num_queries; i++)
+    {
+        listed += findWaitingGames(name, game_ids);
+    }
+    long long waiting_elapsed = benchNow() - start;
+    start = benchNow();
+    for (int i = 0; i < num_queries; i++)
+    {
+        listed += findPlayerGames(name, game_ids);
+    }
+    long long games_elapsed = benchNow() - start;
+    printf("%5d rooms: waiting rooms %8.1f ns, games of the player %6.1f ns (%lld listed)\n", num_rooms,
+           (double)waiting_elapsed / num_queries, (double)games_elapsed / num_queries, listed);
+    free(game_ids);
+}
+
+// num_rooms waiting rooms of 2 to 5 players: read the first page of 9 rooms by age and by fill level, and a filtered
+// page. A page starts at the cursor in the order of the rooms, so it costs about the same for any number of rooms.
+void benchLobby(int num_rooms)
+{
+    benchReset();
+    char name[] = "foo", other[] = "bar";
+    registerClient(name);
+    registerClient(other);
+    for (int i = 0; i < num_rooms; i++)
+    {
+        createNewGameServer(2 + i % 4, BENCH_ROUNDS);
+    }
+    for (int i = 1; i <= num_rooms; i += 3)
+    {
+        joinGame(i, other);
+    }
+    LobbyQuery queries[3] = {{9, LOBBY_BY_AGE, 0, 0, 0, 0}, {9, LOBBY_BY_FILL, 0, 0, 0, 0}, {9, LOBBY_BY_AGE, 0, 5, 0, 4}};
+    double elapsed[3];
+    long long listed = 0;
+    int num_queries = 100000;
+    LobbyPage page;
+    for (int q = 0; q < 3; q++)
+    {
+        long long start = benchNow();
+        for (int i = 0; i < num_queries; i++)
+        {
+            queryLobby(name, &queries[q], &page);
+            listed += page.count;
+        }
+        elapsed[q] = (double)(benchNow() - start) / num_queries;
+    }
+    printf("%5d rooms: page by age %6.1f ns, by fill %6.1f ns, 5 players with 4 free seats %6.1f ns (%lld listed)\n",
+           num_rooms, elapsed[0], elapsed[1], elapsed[2], listed);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = argc > 1 ? argv[1] : "all";
+    if (strcmp(name, "all") == 0 || strcmp(name, "wakeups") == 0)
+    {
+        printf("Worker wakeups per move\n");
+        for (int num_games = 10; num_games <= 10000; num_games *= 10)
+        {
+            benchWakeups(num_games, 4);
+        }
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "requests") == 0)
+    {
+        printf("Request throughput by number of request workers (0: run on the server loop)\n");
+        benchReset();
+        // 1000 waiting rooms, so listing them is real work; game 1 is being played
+        char name1[] = "foo", name2[] = "bar";
+        for (int i = 0; i < 1000; i++)
+        {
+            createNewGameServer(2, BENCH_ROUNDS);
+        }
+        joinGame(1, name1);
+        joinGame(1, name2);
+        int worker_counts[] = {0, 1, 2, 4, 8};
+        for (int i = 0; i < 5; i++)
+        {
+            benchRequests(CMD_WAITING_GAMES, "", worker_counts[i]);
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            benchRequests(CMD_GAME_INFO, "1", worker_counts[i]);
+        }
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "scoring") == 0)
+    {
+        printf("Scoring a round\n");
+        benchScoring(5);
+        benchScoring(50);
+        benchScoring(500);
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "soak") == 0)
+    {
+        printf("Memory over a million games\n");
+        benchSoak(1000000);
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "timers") == 0)
+    {
+        printf("Game deadlines in the timer wheel\n");
+        benchTimers(1000);
+        benchTimers(10000);
+        benchTimers(MAX_GAMES - 1);
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "players") == 0)
+    {
+        printf("Player registry\n");
+        benchPlayers(100);
+        benchPlayers(10000);
+        benchPlayers(1000000);
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "leaderboard") == 0)
+    {
+        printf("Ranked leaderboard\n");
+        benchLeaderboard(100);
+        benchLeaderboard(10000);
+        benchLeaderboard(1000000);
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "lists") == 0)
+    {
+        printf("Game lists\n");
+        benchGameLists(100);
+        benchGameLists(1000);
+        benchGameLists(10000);
+    }
+    if (strcmp(name, "all") == 0 || strcmp(name, "lobby") == 0)
+    {
+        printf("Lobby pages\n");
+        benchLobby(5);
+        benchLobby(100);
+        benchLobby(MAX_GAMES - 1);
+    }
+    return 0;
+}
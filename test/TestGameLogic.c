@@ -5,23 +5,18 @@
 void setUp(void)
 {
     // Reset the players and games arrays
-    memset(players, 0, sizeof(players));
-    memset(games, 0, sizeof(games));
-    num_players = 0;
-    game_num = 1;
-    pthread_mutex_init(&lock, NULL);
-    pthread_cond_init(&cond, NULL);
+    resetPlayers();
+    resetGames();
+    round_timeout = 0;
+    lobby_timeout = 0;
+    setupForThreads();
     usleep(1000);
 }
 
 void tearDown(void)
 {
-    // Stop the threads of all running games
-    for (int i = 0; i < num_threads; i++) {
-        pthread_cancel(thread_ids[i]);
-        pthread_join(thread_ids[i], NULL);
-    }
-    num_threads = 0;
+    // Stop the game workers if a test started them
+    stopWorkers();
 }
 
 
@@ -57,37 +52,37 @@ void test_register_user(void)
 void test_create_game(void)
 {
     createNewGameServer(2, 2);
-    TEST_ASSERT_TRUE(game_num == 2);
-    TEST_ASSERT_TRUE(games[1].num_players == 2);
-    TEST_ASSERT_TRUE(games[1].num_rounds == 2);
-    TEST_ASSERT_TRUE(games[1].current_round == 1);
-    TEST_ASSERT_TRUE(games[1].num_joined_players == 0);
-    TEST_ASSERT_TRUE(games[1].num_current_round == 0);
-    TEST_ASSERT_TRUE(games[1].started == false);
-    TEST_ASSERT_TRUE(games[1].active == true);
+    TEST_ASSERT_TRUE(game_table.num_live == 1);
+    TEST_ASSERT_TRUE(getGame(1)->num_players == 2);
+    TEST_ASSERT_TRUE(getGame(1)->num_rounds == 2);
+    TEST_ASSERT_TRUE(getGame(1)->current_round == 1);
+    TEST_ASSERT_TRUE(getGame(1)->num_joined_players == 0);
+    TEST_ASSERT_TRUE(getGame(1)->num_current_round == 0);
+    TEST_ASSERT_TRUE(getGame(1)->started == false);
+    TEST_ASSERT_TRUE(getGame(1)->active == true);
 }
 
 void test_create_multiple_games(void)
 {
     createNewGameServer(2, 3);
-    TEST_ASSERT_TRUE(game_num == 2);
-    TEST_ASSERT_TRUE(games[1].num_players == 2);
-    TEST_ASSERT_TRUE(games[1].num_rounds == 3);
-    TEST_ASSERT_TRUE(games[1].current_round == 1);
-    TEST_ASSERT_TRUE(games[1].num_joined_players == 0);
-    TEST_ASSERT_TRUE(games[1].num_current_round == 0);
-    TEST_ASSERT_TRUE(games[1].started == false);
-    TEST_ASSERT_TRUE(games[1].active == true);
+    TEST_ASSERT_TRUE(game_table.num_live == 1);
+    TEST_ASSERT_TRUE(getGame(1)->num_players == 2);
+    TEST_ASSERT_TRUE(getGame(1)->num_rounds == 3);
+    TEST_ASSERT_TRUE(getGame(1)->current_round == 1);
+    TEST_ASSERT_TRUE(getGame(1)->num_joined_players == 0);
+    TEST_ASSERT_TRUE(getGame(1)->num_current_round == 0);
+    TEST_ASSERT_TRUE(getGame(1)->started == false);
+    TEST_ASSERT_TRUE(getGame(1)->active == true);
     
     createNewGameServer(3, 4);
-    TEST_ASSERT_TRUE(game_num == 3);
-    TEST_ASSERT_TRUE(games[2].num_players == 3);
-    TEST_ASSERT_TRUE(games[2].num_rounds == 4);
-    TEST_ASSERT_TRUE(games[2].current_round == 1);
-    TEST_ASSERT_TRUE(games[2].num_joined_players == 0);
-    TEST_ASSERT_TRUE(games[2].num_current_round == 0);
-    TEST_ASSERT_TRUE(games[2].started == false);
-    TEST_ASSERT_TRUE(games[2].active == true);
+    TEST_ASSERT_TRUE(game_table.num_live == 2);
+    TEST_ASSERT_TRUE(getGame(2)->num_players == 3);
+    TEST_ASSERT_TRUE(getGame(2)->num_rounds == 4);
+    TEST_ASSERT_TRUE(getGame(2)->current_round == 1);
+    TEST_ASSERT_TRUE(getGame(2)->num_joined_players == 0);
+    TEST_ASSERT_TRUE(getGame(2)->num_current_round == 0);
+    TEST_ASSERT_TRUE(getGame(2)->started == false);
+    TEST_ASSERT_TRUE(getGame(2)->active == true);
 }
 
 void test_join_game(void)
@@ -99,16 +94,16 @@ void test_join_game(void)
     
     joinGame(1, client_name);
     
-    TEST_ASSERT_TRUE(games[1].num_joined_players == 1);
-    TEST_ASSERT_TRUE(strcmp(games[1].playerNames[0], client_name) == 0);
-    TEST_ASSERT_TRUE(games[1].playerScores[0] == 0);
+    TEST_ASSERT_TRUE(getGame(1)->num_joined_players == 1);
+    TEST_ASSERT_TRUE(strcmp(getGame(1)->playerNames[0], client_name) == 0);
+    TEST_ASSERT_TRUE(getGame(1)->playerScores[0] == 0);
 
     char client_name2[] = "bar";
     registerClient(client_name2);
     joinGame(1, client_name2);
-    TEST_ASSERT_TRUE(games[1].num_joined_players == 2);
-    TEST_ASSERT_TRUE(strcmp(games[1].playerNames[1], client_name2) == 0);
-    TEST_ASSERT_TRUE(games[1].playerScores[1] == 0);
+    TEST_ASSERT_TRUE(getGame(1)->num_joined_players == 2);
+    TEST_ASSERT_TRUE(strcmp(getGame(1)->playerNames[1], client_name2) == 0);
+    TEST_ASSERT_TRUE(getGame(1)->playerScores[1] == 0);
 }
 
 void test_join_multiple_games(void){
@@ -120,30 +115,30 @@ void test_join_multiple_games(void){
     char client_name[] = "foo";
     registerClient(client_name);
     joinGame(1, client_name);
-    TEST_ASSERT_TRUE(games[1].num_joined_players == 1);
-    TEST_ASSERT_TRUE(strcmp(games[1].playerNames[0], client_name) == 0);
-    TEST_ASSERT_TRUE(games[1].playerScores[0] == 0);
+    TEST_ASSERT_TRUE(getGame(1)->num_joined_players == 1);
+    TEST_ASSERT_TRUE(strcmp(getGame(1)->playerNames[0], client_name) == 0);
+    TEST_ASSERT_TRUE(getGame(1)->playerScores[0] == 0);
 
     char client_name2[] = "bar";
     registerClient(client_name2);
     joinGame(1, client_name2);
-    TEST_ASSERT_TRUE(games[1].num_joined_players == 2);
-    TEST_ASSERT_TRUE(strcmp(games[1].playerNames[1], client_name2) == 0);
-    TEST_ASSERT_TRUE(games[1].playerScores[1] == 0);
+    TEST_ASSERT_TRUE(getGame(1)->num_joined_players == 2);
+    TEST_ASSERT_TRUE(strcmp(getGame(1)->playerNames[1], client_name2) == 0);
+    TEST_ASSERT_TRUE(getGame(1)->playerScores[1] == 0);
 
     char client_name3[] = "baz";
     registerClient(client_name3);
     joinGame(2, client_name3);
-    TEST_ASSERT_TRUE(games[2].num_joined_players == 1);
-    TEST_ASSERT_TRUE(strcmp(games[2].playerNames[0], client_name3) == 0);
-    TEST_ASSERT_TRUE(games[2].playerScores[0] == 0);
+    TEST_ASSERT_TRUE(getGame(2)->num_joined_players == 1);
+    TEST_ASSERT_TRUE(strcmp(getGame(2)->playerNames[0], client_name3) == 0);
+    TEST_ASSERT_TRUE(getGame(2)->playerScores[0] == 0);
 
     char client_name4[] = "qux";
     registerClient(client_name4);
     joinGame(2, client_name4);
-    TEST_ASSERT_TRUE(games[2].num_joined_players == 2);
-    TEST_ASSERT_TRUE(strcmp(games[2].playerNames[1], client_name4) == 0);
-    TEST_ASSERT_TRUE(games[2].playerScores[1] == 0);
+    TEST_ASSERT_TRUE(getGame(2)->num_joined_players == 2);
+    TEST_ASSERT_TRUE(strcmp(getGame(2)->playerNames[1], client_name4) == 0);
+    TEST_ASSERT_TRUE(getGame(2)->playerScores[1] == 0);
 }
 
 void test_get_gameinfo_notstarted(void){
@@ -308,6 +303,824 @@ void test_games(void){
     free(waitingGames);
 }
 
+void test_shm_request_ring(void)
+{
+    ShmSegment *segment = malloc(sizeof(ShmSegment));
+    shmInitSegment(segment);
+    ShmRequestSlot request;
+    TEST_ASSERT_FALSE(shmRequestPop(&segment->requests, &request));
+
+    TEST_ASSERT_TRUE(shmRequestPush(&segment->requests, 3, 1, "foo: C", 7));
+    TEST_ASSERT_TRUE(shmRequestPush(&segment->requests, 4, 2, "bar: 4L", 8));
+    TEST_ASSERT_TRUE(shmRequestPop(&segment->requests, &request));
+    TEST_ASSERT_TRUE(request.ring == 3 && request.generation == 1);
+    TEST_ASSERT_TRUE(strcmp(request.data, "foo: C") == 0);
+    TEST_ASSERT_TRUE(shmRequestPop(&segment->requests, &request));
+    TEST_ASSERT_TRUE(request.ring == 4 && request.generation == 2);
+    TEST_ASSERT_TRUE(strcmp(request.data, "bar: 4L") == 0);
+    TEST_ASSERT_FALSE(shmRequestPop(&segment->requests, &request));
+
+    // A full ring refuses new requests until the server reads
+    for (int i = 0; i < SHM_REQUEST_SLOTS; i++)
+    {
+        TEST_ASSERT_TRUE(shmRequestPush(&segment->requests, 0, 0, "foo: SW", 8));
+    }
+    TEST_ASSERT_FALSE(shmRequestPush(&segment->requests, 0, 0, "foo: SW", 8));
+    TEST_ASSERT_TRUE(shmRequestPop(&segment->requests, &request));
+    TEST_ASSERT_TRUE(shmRequestPush(&segment->requests, 0, 0, "foo: SG", 8));
+    free(segment);
+}
+
+void test_shm_response_ring(void)
+{
+    ShmSegment *segment = malloc(sizeof(ShmSegment));
+    shmInitSegment(segment);
+    ShmResponseRing *ring = &segment->responses[0];
+    char buffer[SHM_RESPONSE_RING_SIZE];
+
+    // Fill the ring almost completely, then write across the end of it
+    memset(buffer, 'x', sizeof(buffer));
+    TEST_ASSERT_TRUE(shmResponseWrite(ring, buffer, SHM_RESPONSE_RING_SIZE - 4) == SHM_RESPONSE_RING_SIZE - 4);
+    TEST_ASSERT_TRUE(shmResponseRead(ring, buffer, sizeof(buffer)) == SHM_RESPONSE_RING_SIZE - 4);
+    TEST_ASSERT_TRUE(shmResponseWrite(ring, "registered", 11) == 11);
+    TEST_ASSERT_TRUE(shmResponseRead(ring, buffer, sizeof(buffer)) == 11);
+    TEST_ASSERT_TRUE(strcmp(buffer, "registered") == 0);
+    TEST_ASSERT_TRUE(shmResponseRead(ring, buffer, sizeof(buffer)) == 0);
+
+    // Only what fits is written
+    TEST_ASSERT_TRUE(shmResponseWrite(ring, buffer, sizeof(buffer)) == SHM_RESPONSE_RING_SIZE);
+    TEST_ASSERT_TRUE(shmResponseWrite(ring, "a", 1) == 0);
+    free(segment);
+}
+
+void test_frame_reader(void)
+{
+    FrameReader reader = {NULL, 0, 0, 0};
+    FrameHeader header;
+    const char *payload;
+    char stream[BUFSIZ];
+    size_t first_length = encodeFrame(stream, CMD_JOIN_GAME, 1, 0, "foo", "3", 1);
+    size_t length = first_length + encodeFrame(stream + first_length, CMD_LEADERBOARD, 2, 0, "bar", "", 0);
+
+    // Two messages in one read
+    memcpy(frameReaderReserve(&reader, length), stream, length);
+    frameReaderCommit(&reader, length);
+    TEST_ASSERT_TRUE(frameReaderNext(&reader, &header, &payload) == 1);
+    TEST_ASSERT_TRUE(header.command == CMD_JOIN_GAME && header.correlation_id == 1 && header.length == 1);
+    TEST_ASSERT_TRUE(strcmp(header.sender, "foo") == 0 && payload[0] == '3');
+    TEST_ASSERT_TRUE(frameReaderNext(&reader, &header, &payload) == 1);
+    TEST_ASSERT_TRUE(header.command == CMD_LEADERBOARD && header.length == 0);
+    TEST_ASSERT_TRUE(frameReaderNext(&reader, &header, &payload) == 0);
+
+    // One message in many reads
+    for (size_t i = 0; i < first_length; i++)
+    {
+        TEST_ASSERT_TRUE(frameReaderNext(&reader, &header, &payload) == 0);
+        *frameReaderReserve(&reader, 1) = stream[i];
+        frameReaderCommit(&reader, 1);
+    }
+    TEST_ASSERT_TRUE(frameReaderNext(&reader, &header, &payload) == 1);
+    TEST_ASSERT_TRUE(strcmp(header.sender, "foo") == 0 && payload[0] == '3');
+    TEST_ASSERT_TRUE(findCommandCode("MD", 2) == CMD_MAKE_DECISION);
+    TEST_ASSERT_TRUE(findCommandCode("XX", 2) == CMD_NONE);
+    frameReaderFree(&reader);
+}
+
+void test_binary_game_info(void)
+{
+    Game game;
+    memset(&game, 0, sizeof(game));
+    TEST_ASSERT_TRUE(allocateGameRecord(&game, 3, 3));
+    strcpy(game.playerNames[0], "foo");
+    strcpy(game.playerNames[1], "quxxy");
+    strcpy(game.playerNames[2], "b");
+    game.playerScores[0] = 1;
+    game.playerScores[1] = 300;
+    game.round_moves[0] = packRoundMoves("rps");
+    game.round_moves[1] = packRoundMoves("snn");
+    game.current_round = 2;
+    uint8_t buffer[GAME_INFO_MAX_SIZE];
+    GameInfoView view;
+
+    TEST_ASSERT_TRUE(encodeGameInfo(&game, buffer) == 1);
+    TEST_ASSERT_TRUE(decodeGameInfo(buffer, 1, &view));
+    TEST_ASSERT_FALSE(view.started);
+
+    game.started = true;
+    size_t length = encodeGameInfo(&game, buffer);
+    TEST_ASSERT_TRUE(decodeGameInfo(buffer, length, &view));
+    TEST_ASSERT_FALSE(decodeGameInfo(buffer, length - 1, &view));
+    TEST_ASSERT_TRUE(decodeGameInfo(buffer, length, &view));
+    TEST_ASSERT_TRUE(view.started && view.num_players == 3 && view.current_round == 2 && view.num_rounds == 3);
+    char name[PLAYER_ID_WIDTH + 1];
+    gameInfoPlayer(&view, 1, name);
+    TEST_ASSERT_TRUE(strcmp(name, "quxxy") == 0);
+    gameInfoPlayer(&view, 2, name);
+    TEST_ASSERT_TRUE(strcmp(name, "b") == 0);
+    TEST_ASSERT_TRUE(view.scores[0] == 1 && view.scores[1] == 300 && view.scores[2] == 0);
+    TEST_ASSERT_TRUE(gameInfoMove(&view, 0, 0) == 'r' && gameInfoMove(&view, 0, 1) == 'p' && gameInfoMove(&view, 0, 2) == 's');
+    TEST_ASSERT_TRUE(gameInfoMove(&view, 1, 0) == 's' && gameInfoMove(&view, 1, 1) == 'n');
+    freeGameRecord(&game);
+}
+
+void test_binary_lists(void)
+{
+    int game_ids[] = {1, 2, 200};
+    int decoded[MAX_GAMES];
+    StringBuilder list = {NULL, 0, 0};
+    TEST_ASSERT_TRUE(encodeGameList(&list, game_ids, 3));
+    TEST_ASSERT_TRUE(decodeGameList((const uint8_t *)list.data, list.length, decoded, MAX_GAMES) == 3);
+    TEST_ASSERT_TRUE(decoded[0] == 1 && decoded[1] == 2 && decoded[2] == 200);
+    TEST_ASSERT_TRUE(decodeGameList((const uint8_t *)list.data, list.length - 1, decoded, MAX_GAMES) == -1);
+    free(list.data);
+
+    char client_name[] = "foo";
+    registerClient(client_name);
+    char client_name2[] = "bar";
+    registerClient(client_name2);
+    players[1].score = 5;
+    StringBuilder leaderboard = {NULL, 0, 0};
+    TEST_ASSERT_TRUE(encodeLeaderBoard(&leaderboard));
+    Player decoded_players[2];
+    TEST_ASSERT_TRUE(decodeLeaderBoard((const uint8_t *)leaderboard.data, leaderboard.length, decoded_players, 2) == 2);
+    TEST_ASSERT_TRUE(strcmp(decoded_players[1].name, "bar") == 0 && decoded_players[1].score == 5);
+    free(leaderboard.data);
+}
+
+void test_game_subscription(void)
+{
+    int fds[2];
+    TEST_ASSERT_TRUE(pipe(fds) == 0);
+    Connection *connection = allocateConnection(fds[1], 0);
+    // Only an existing game can be followed
+    TEST_ASSERT_FALSE(subscribeGame(connection, 1));
+    createNewGameServer(2, 3);
+    TEST_ASSERT_TRUE(subscribeGame(connection, 1));
+    TEST_ASSERT_TRUE(subscribers[1].count == 1);
+
+    // Two changes before the loop runs are pushed as one update
+    notifyGameChanged(1);
+    notifyGameChanged(1);
+    notifyGameChanged(2);
+    publishGameUpdates();
+    char buffer[BUFSIZ];
+    ssize_t length = read(fds[0], buffer, sizeof(buffer));
+    FrameHeader header;
+    const char *payload;
+    TEST_ASSERT_TRUE(decodeFrame(buffer, (size_t)length, &header, &payload));
+    TEST_ASSERT_TRUE((size_t)length == sizeof(FrameHeader) + header.length);
+    TEST_ASSERT_TRUE(header.flags == (FRAME_FLAG_BINARY | FRAME_FLAG_PUSH) && header.correlation_id == 0);
+    TEST_ASSERT_TRUE(payload[0] == 1);
+
+    // A closed connection does not follow the game any more
+    closeConnection(connection);
+    TEST_ASSERT_TRUE(subscribers[1].count == 0);
+    close(fds[0]);
+}
+
+void test_game_delta(void)
+{
+    Game game;
+    memset(&game, 0, sizeof(game));
+    TEST_ASSERT_TRUE(allocateGameRecord(&game, 2, 3));
+    strcpy(game.playerNames[0], "foo");
+    strcpy(game.playerNames[1], "bar");
+    game.current_round = 1;
+    game.started = true;
+    game.version = 5;
+    game.state_version = 5;
+    uint8_t full[GAME_DELTA_MAX_SIZE];
+    uint8_t delta[GAME_DELTA_MAX_SIZE];
+    GameState state;
+    memset(&state, 0, sizeof(state));
+
+    // A client without a copy gets the full game
+    size_t full_length = encodeGameDelta(&game, 0, full);
+    TEST_ASSERT_TRUE(applyGameDelta(&state, full, full_length));
+    TEST_ASSERT_TRUE(state.version == 5 && state.started && state.num_players == 2);
+    TEST_ASSERT_TRUE(strcmp(state.player_ids[1], "bar") == 0);
+
+    // Only the changed round is sent
+    game.round_moves[0] = packRoundMoves("rn");
+    touchGame(&game, &game.round_versions[0]);
+    size_t length = encodeGameDelta(&game, 5, delta);
+    TEST_ASSERT_TRUE(length < full_length);
+    TEST_ASSERT_TRUE(applyGameDelta(&state, delta, length));
+    TEST_ASSERT_TRUE(state.version == 6);
+    TEST_ASSERT_TRUE(gameStateMove(&state, 0, 0) == 'r' && gameStateMove(&state, 0, 1) == 'n');
+
+    // The end of the round changes the scores and the current round
+    game.round_moves[0] = packRoundMoves("rs");
+    touchGame(&game, &game.round_versions[0]);
+    game.playerScores[0] = 1;
+    touchGame(&game, &game.scores_version);
+    game.current_round = 2;
+    touchGame(&game, &game.state_version);
+    length = encodeGameDelta(&game, 6, delta);
+    TEST_ASSERT_TRUE(applyGameDelta(&state, delta, length));
+    TEST_ASSERT_TRUE(state.version == 9 && state.current_round == 2 && state.scores[0] == 1);
+    TEST_ASSERT_TRUE(gameStateMove(&state, 0, 1) == 's' && gameStateMove(&state, 1, 0) == 'n');
+
+    // A delta needs a copy to apply to and a client too far behind gets the full game again
+    GameState empty;
+    memset(&empty, 0, sizeof(empty));
+    TEST_ASSERT_FALSE(applyGameDelta(&empty, delta, length));
+    game.version = 10 + GAME_DELTA_MAX_GAP;
+    length = encodeGameDelta(&game, 9, delta);
+    TEST_ASSERT_TRUE(applyGameDelta(&empty, delta, length));
+    TEST_ASSERT_TRUE(empty.scores[0] == 1 && gameStateMove(&empty, 0, 0) == 'r');
+    freeGameRecord(&game);
+}
+
+void test_command_arguments(void)
+{
+    CommandArgs args;
+    Span rest = {"12,ab", 5};
+    Span token;
+
+    // The tokenizer points into the original string
+    TEST_ASSERT_TRUE(nextToken(&rest, ',', &token));
+    TEST_ASSERT_TRUE(token.length == 2 && strncmp(token.data, "12", 2) == 0);
+    TEST_ASSERT_TRUE(nextToken(&rest, ',', &token));
+    TEST_ASSERT_TRUE(token.length == 2 && strncmp(token.data, "ab", 2) == 0);
+    TEST_ASSERT_FALSE(nextToken(&rest, ',', &token));
+
+    // Valid arguments
+    TEST_ASSERT_TRUE(parseArguments(ARGS_NEW_GAME, (Span){"3,2", 3}, &args));
+    TEST_ASSERT_TRUE(args.num_players == 3 && args.num_rounds == 2);
+    TEST_ASSERT_TRUE(parseArguments(ARGS_NEW_GAME, (Span){"300,50", 6}, &args));
+    TEST_ASSERT_TRUE(args.num_players == 300 && args.num_rounds == 50);
+    TEST_ASSERT_TRUE(parseArguments(ARGS_DECISION, (Span){"7,s", 3}, &args));
+    TEST_ASSERT_TRUE(args.game_id == 7 && args.decision == 's');
+    TEST_ASSERT_TRUE(parseArguments(ARGS_GAME_VERSION, (Span){"1,4000000000", 12}, &args));
+    TEST_ASSERT_TRUE(args.version == 4000000000u);
+    TEST_ASSERT_TRUE(parseArguments(ARGS_PAGE, (Span){"3,20", 4}, &args));
+    TEST_ASSERT_TRUE(args.page == 3 && args.page_size == 20);
+    TEST_ASSERT_TRUE(parseArguments(ARGS_RANK, (Span){"2", 1}, &args));
+    TEST_ASSERT_TRUE(args.around == 2 && args.player[0] == '\0');
+    TEST_ASSERT_TRUE(parseArguments(ARGS_RANK, (Span){"0,abc", 5}, &args));
+    TEST_ASSERT_TRUE(args.around == 0 && strcmp(args.player, "abc") == 0);
+
+    // Invalid arguments are rejected before any handler runs
+    TEST_ASSERT_FALSE(parseArguments(ARGS_GAME, (Span){"", 0}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_GAME, (Span){"0", 1}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_GAME, (Span){"1x", 2}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_GAME, (Span){"-1", 2}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_NEW_GAME, (Span){"900,2", 5}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_NEW_GAME, (Span){"9,200", 5}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_NEW_GAME, (Span){"2", 1}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_DECISION, (Span){"1,x", 3}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_DECISION, (Span){"1,rr", 4}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_PAGE, (Span){"1,500", 5}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_PAGE, (Span){"0,10", 4}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_RANK, (Span){"1,abcdef", 8}, &args));
+}
+
+bool gameStarted(int game_id)
+{
+    pthread_mutex_lock(&getGame(game_id)->lock);
+    bool started = getGame(game_id)->started;
+    pthread_mutex_unlock(&getGame(game_id)->lock);
+    return started;
+}
+
+void test_game_workers(void)
+{
+    char client_name[] = "foo";
+    registerClient(client_name);
+    char client_name2[] = "bar";
+    registerClient(client_name2);
+    TEST_ASSERT_TRUE(startWorkers(2));
+    TEST_ASSERT_TRUE(num_threads == 2);
+
+    createNewGameServer(2, 2);
+    createNewGameServer(2, 1);
+    joinGame(1, client_name);
+    joinGame(2, client_name);
+    joinGame(1, client_name2);
+    joinGame(2, client_name2);
+    // The workers start the games
+    while (!gameStarted(1) || !gameStarted(2))
+    {
+        usleep(100);
+    }
+    // A full game cannot be joined
+    char client_name3[] = "baz";
+    TEST_ASSERT_FALSE(joinGame(1, client_name3));
+
+    makeDecision((char*)"2", (char*)"s", client_name);
+    makeDecision((char*)"2", (char*)"p", client_name2);
+    makeDecision((char*)"1", (char*)"r", client_name);
+    makeDecision((char*)"1", (char*)"s", client_name2);
+    // Wait for the second round of game 1 to start
+    while (true)
+    {
+        pthread_mutex_lock(&getGame(1)->lock);
+        int round = getGame(1)->current_round;
+        pthread_mutex_unlock(&getGame(1)->lock);
+        if (round == 2)
+        {
+            break;
+        }
+        usleep(100);
+    }
+    makeDecision((char*)"1", (char*)"r", client_name);
+    makeDecision((char*)"1", (char*)"r", client_name2);
+
+    // Stopping runs the games that are still queued
+    stopWorkers();
+    TEST_ASSERT_TRUE(num_threads == 0);
+    TEST_ASSERT_TRUE(getGame(1)->phase == GAME_FINISHED && getGame(2)->phase == GAME_FINISHED);
+    char *leaderboard = getLeaderBoard();
+    TEST_ASSERT_TRUE(strcmp(leaderboard, "foo,2,2;bar,0,2;") == 0);
+    free(leaderboard);
+}
+
+void test_game_locks(void)
+{
+    char client_name[] = "foo";
+    registerClient(client_name);
+    createNewGameServer(2, 3);
+    createNewGameServer(2, 3);
+
+    // While a game is locked the leaderboard and the other games can still be used
+    pthread_mutex_lock(&getGame(1)->lock);
+    char *leaderboard = getLeaderBoard();
+    TEST_ASSERT_TRUE(strcmp(leaderboard, "foo,0,0;") == 0);
+    free(leaderboard);
+    TEST_ASSERT_TRUE(joinGame(2, client_name));
+    pthread_mutex_unlock(&getGame(1)->lock);
+
+    TEST_ASSERT_TRUE(joinGame(1, client_name));
+}
+
+void test_move_submission(void)
+{
+    char client_name[] = "foo", client_name2[] = "bar";
+    registerClient(client_name);
+    registerClient(client_name2);
+    createNewGameServer(2, 3);
+
+    // No decisions before the game started
+    makeMove(1, 'r', client_name);
+    TEST_ASSERT_TRUE(getGame(1)->round_moves[0] == 0);
+    joinGame(1, client_name);
+    joinGame(1, client_name2);
+    TEST_ASSERT_TRUE(getGame(1)->phase == GAME_PLAYING);
+
+    // The first decision of a player counts, the round ends when the submitted mask has every player
+    makeMove(1, 'p', client_name2);
+    makeMove(1, 'r', client_name2);
+    TEST_ASSERT_TRUE(getGame(1)->round_moves[0] == packRoundMoves("np"));
+    TEST_ASSERT_TRUE(roundSubmitted(getGame(1)->round_moves[0]) == 2);
+    TEST_ASSERT_TRUE(getGame(1)->current_round == 1);
+    makeMove(1, 'r', client_name);
+    TEST_ASSERT_TRUE(getGame(1)->current_round == 2);
+    TEST_ASSERT_TRUE(roundMove(getGame(1)->round_moves[0], 0) == MOVE_ROCK && getGame(1)->playerScores[1] == 1);
+    char *game_info = getGameInfo(1);
+    TEST_ASSERT_TRUE(strcmp(game_info, "GI;2;foo,bar;2,3;0,1;rp,nn;") == 0);
+    free(game_info);
+}
+
+void test_game_slots(void)
+{
+    char client_name[] = "foo", client_name2[] = "bar";
+    registerClient(client_name);
+    registerClient(client_name2);
+    createNewGameServer(2, 3);
+    joinGame(1, client_name);
+    joinGame(1, client_name2);
+    int fds[2];
+    TEST_ASSERT_TRUE(pipe(fds) == 0);
+    Connection *connection = allocateConnection(fds[1], 0);
+    TEST_ASSERT_TRUE(subscribeGame(connection, 1));
+    for (int round = 0; round < 3; round++)
+    {
+        makeMove(1, 'r', client_name);
+        makeMove(1, 's', client_name2);
+    }
+    TEST_ASSERT_TRUE(getGame(1)->phase == GAME_FINISHED && game_table.num_live == 0);
+
+    // A finished game that is still followed keeps its slot
+    createNewGameServer(2, 3);
+    TEST_ASSERT_TRUE(getGame(1) != NULL && getGame(2) != NULL);
+    closeConnection(connection);
+    close(fds[0]);
+
+    // Then its slot is reused with a new generation, and the old ID does not find the new game
+    createNewGameServer(2, 3);
+    int new_id = (1 << GAME_SLOT_BITS) | 1;
+    TEST_ASSERT_TRUE(game_table.num_slots == 3 && game_table.num_live == 2);
+    TEST_ASSERT_TRUE(getGame(1) == NULL && getGame(new_id) == gameAtSlot(1));
+    TEST_ASSERT_FALSE(joinGame(1, client_name));
+    TEST_ASSERT_TRUE(joinGame(new_id, client_name));
+    char *game_info = getGameInfo(1);
+    TEST_ASSERT_TRUE(strcmp(game_info, "notstarted") == 0);
+    free(game_info);
+    int game_ids[MAX_GAMES];
+    TEST_ASSERT_TRUE(findPlayerGames(client_name, game_ids) == 1 && game_ids[0] == new_id);
+}
+
+void test_game_arena(void)
+{
+    Game game;
+    memset(&game, 0, sizeof(game));
+    TEST_ASSERT_TRUE(allocateGameRecord(&game, 300, 50));
+    char *base = game.arena.base;
+    game.playerScores[299] = 7;
+    strcpy(game.playerNames[0], "foo");
+
+    // A smaller game in the same slot uses the same block, cleared
+    TEST_ASSERT_TRUE(allocateGameRecord(&game, 2, 3));
+    TEST_ASSERT_TRUE(game.arena.base == base && game.arena.used <= game.arena.capacity);
+    TEST_ASSERT_TRUE(game.playerScores[0] == 0 && game.playerScores[1] == 0 && game.playerNames[0][0] == '\0');
+    TEST_ASSERT_TRUE((uintptr_t)game.player_ids % sizeof(int) == 0 && (uintptr_t)game.round_moves % sizeof(uint32_t) == 0);
+    TEST_ASSERT_TRUE(arenaAlloc(&game.arena, game.arena.capacity) == NULL);
+
+    freeGameRecord(&game);
+    TEST_ASSERT_TRUE(game.arena.base == NULL && game.arena.capacity == 0);
+}
+
+void test_timer_wheel(void)
+{
+    GameDeadline expired[MAX_GAMES];
+    uint64_t now = timerNow();
+    // Far enough to start in the third level of the wheel
+    armGameTimer(3, 1, now + 5000);
+    armGameTimer(4, 1, now + 70);
+    // Arming again replaces the deadline, a cancelled one does not expire
+    armGameTimer(4, 2, now + 100);
+    armGameTimer(5, 1, now + 30);
+    cancelGameTimer(5);
+    TEST_ASSERT_TRUE(timer_wheel.count == 2);
+    TEST_ASSERT_TRUE(advanceTimers(now + 99, expired) == 0);
+    TEST_ASSERT_TRUE(advanceTimers(now + 100, expired) == 1 && expired[0].game_id == 4 && expired[0].round == 2);
+    TEST_ASSERT_TRUE(advanceTimers(now + 4999, expired) == 0);
+    TEST_ASSERT_TRUE(advanceTimers(now + 5000, expired) == 1 && expired[0].game_id == 3);
+    TEST_ASSERT_TRUE(timerTimeout() == -1);
+}
+
+void test_game_deadlines(void)
+{
+    char client_name[] = "foo", client_name2[] = "bar";
+    registerClient(client_name);
+    registerClient(client_name2);
+    round_timeout = 5;
+    lobby_timeout = 10;
+    uint64_t now = timerNow();
+    createNewGameServer(2, 3);
+    createNewGameServer(2, 3);
+    joinGame(1, client_name);
+    joinGame(1, client_name2);
+    joinGame(2, client_name);
+    makeMove(1, 'r', client_name);
+
+    // bar did not move in time, so bar forfeits the first round
+    TEST_ASSERT_TRUE(expireTimers(now + 49) == 0);
+    TEST_ASSERT_TRUE(expireTimers(now + 60) == 1);
+    char *game_info = getGameInfo(1);
+    TEST_ASSERT_TRUE(strcmp(game_info, "GI;2;foo,bar;2,3;0,0;rn,nn;") == 0);
+    free(game_info);
+
+    // The second round has its own deadline and the waiting room of game 2 is closed
+    TEST_ASSERT_TRUE(expireTimers(now + 200) == 2);
+    TEST_ASSERT_TRUE(getGame(1)->current_round == 3 && getGame(2)->phase == GAME_FINISHED);
+    TEST_ASSERT_FALSE(joinGame(2, client_name2));
+    int game_ids[MAX_GAMES];
+    TEST_ASSERT_TRUE(findPlayerGames(client_name, game_ids) == 1 && game_ids[0] == 1);
+}
+
+void test_player_registry(void)
+{
+    // More players than the first index has room for, every one gets the next ID
+    char name[6];
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(name, sizeof(name), "p%d", i);
+        TEST_ASSERT_TRUE(registerClient(name));
+    }
+    TEST_ASSERT_TRUE(num_players == 1000 && player_index.size >= 2000);
+    TEST_ASSERT_FALSE(registerClient((char *)"p999"));
+    TEST_ASSERT_FALSE(registerClient((char *)""));
+    TEST_ASSERT_TRUE(playerId("p0") == 0 && playerId("p999") == 999 && playerId("q1") == -1);
+    TEST_ASSERT_TRUE(strcmp(players[500].name, "p500") == 0);
+
+    // A game keeps the IDs of its players. A name that joins without registering gets an ID but no leaderboard entry.
+    createNewGameServer(2, 3);
+    TEST_ASSERT_TRUE(joinGame(1, (char *)"p500"));
+    TEST_ASSERT_TRUE(joinGame(1, (char *)"q1"));
+    TEST_ASSERT_TRUE(getGame(1)->player_ids[0] == 500 && getGame(1)->player_ids[1] == 1000);
+    TEST_ASSERT_TRUE(isJoined(getGame(1), 500) && !isJoined(getGame(1), 501));
+    TEST_ASSERT_TRUE(num_players == 1001 && num_registered == 1000);
+    TEST_ASSERT_TRUE(registerClient((char *)"q1") && playerId("q1") == 1000 && num_registered == 1001);
+}
+
+void test_game_membership(void)
+{
+    char client_name[] = "foo", client_name2[] = "bar", client_name3[] = "baz";
+    registerClient(client_name);
+    registerClient(client_name2);
+    registerClient(client_name3);
+    int game_ids[MAX_GAMES];
+
+    // Rooms in more than one word of the bitmap, foo joins every third one
+    for (int i = 0; i < 300; i++)
+    {
+        createNewGameServer(2, 3);
+    }
+    for (int i = 1; i <= 300; i += 3)
+    {
+        TEST_ASSERT_TRUE(joinGame(i, client_name));
+    }
+    TEST_ASSERT_TRUE(membership.num_open == 300);
+    TEST_ASSERT_TRUE(findWaitingGames(client_name, game_ids) == 200 && game_ids[0] == 2 && game_ids[199] == 300);
+    TEST_ASSERT_TRUE(findWaitingGames(client_name2, game_ids) == 300);
+    TEST_ASSERT_TRUE(findPlayerGames(client_name, game_ids) == 100 && findPlayerGames(client_name2, game_ids) == 0);
+
+    // A player has one seat in a game, joining again does not take a second one
+    TEST_ASSERT_FALSE(joinGame(4, client_name));
+    TEST_ASSERT_TRUE(getGame(4)->num_joined_players == 1 && findPlayerGames(client_name, game_ids) == 100);
+
+    // A full room is not listed anymore, a game is listed for its players until it ends
+    TEST_ASSERT_TRUE(joinGame(1, client_name2));
+    TEST_ASSERT_TRUE(membership.num_open == 299);
+    TEST_ASSERT_TRUE(findWaitingGames(client_name3, game_ids) == 299 && game_ids[0] == 2);
+    TEST_ASSERT_TRUE(findPlayerGames(client_name2, game_ids) == 1 && game_ids[0] == 1);
+
+    // A room that expires is gone from both lists
+    expireGameDeadline((GameDeadline){4, 0});
+    TEST_ASSERT_TRUE(findWaitingGames(client_name3, game_ids) == 298);
+    TEST_ASSERT_TRUE(findPlayerGames(client_name, game_ids) == 99);
+}
+
+void test_lobby_query(void)
+{
+    char client_name[] = "foo", client_name2[] = "bar";
+    registerClient(client_name);
+    registerClient(client_name2);
+    LobbyPage page, decoded;
+    CommandArgs args;
+
+    // Rooms of 2 to 5 players with 1 to 3 rounds, bar sits in every 10th room
+    for (int i = 0; i < 2000; i++)
+    {
+        createNewGameServer(2 + i % 4, 1 + i % 3);
+    }
+    for (int i = 1; i <= 2000; i += 10)
+    {
+        TEST_ASSERT_TRUE(joinGame(i, client_name2));
+    }
+
+    // The oldest rooms first, page after page until the cursor is 0
+    TEST_ASSERT_TRUE(parseArguments(ARGS_LOBBY, (Span){"50,a,0", 6}, &args));
+    int seen = 0, last_id = 0;
+    do
+    {
+        queryLobby(client_name, &args.lobby, &page);
+        for (int i = 0; i < page.count; i++)
+        {
+            TEST_ASSERT_TRUE(page.rooms[i].game_id > last_id);
+            last_id = page.rooms[i].game_id;
+        }
+        seen += page.count;
+        args.lobby.cursor = page.next_cursor;
+    } while (page.next_cursor != 0);
+    TEST_ASSERT_TRUE(seen == 2000);
+
+    // The rooms a player is in are left out, the fullest rooms come first
+    TEST_ASSERT_TRUE(parseArguments(ARGS_LOBBY, (Span){"5,f,0", 5}, &args));
+    queryLobby(client_name2, &args.lobby, &page);
+    TEST_ASSERT_TRUE(page.count == 5 && page.rooms[0].game_id == 5 && page.rooms[0].num_players == 2);
+    queryLobby(client_name, &args.lobby, &page);
+    TEST_ASSERT_TRUE(page.rooms[0].game_id == 1 && page.rooms[0].num_joined == 1 && page.rooms[1].num_players == 2);
+
+    // Filters: 4 players, 2 rounds and at least 4 free seats. The rooms bar is in have only 3.
+    TEST_ASSERT_TRUE(parseArguments(ARGS_LOBBY, (Span){"50,a,0,4,2,4", 12}, &args));
+    queryLobby(client_name, &args.lobby, &page);
+    TEST_ASSERT_TRUE(page.count == 50 && page.rooms[0].game_id == 23);
+    for (int i = 0; i < page.count; i++)
+    {
+        TEST_ASSERT_TRUE(page.rooms[i].num_players == 4 && page.rooms[i].num_rounds == 2 && page.rooms[i].game_id % 10 != 1);
+    }
+    // A filter that matches nothing stops at the scan limit and tells where to go on
+    TEST_ASSERT_TRUE(parseArguments(ARGS_LOBBY, (Span){"50,a,0,5,5,0", 12}, &args));
+    queryLobby(client_name, &args.lobby, &page);
+    TEST_ASSERT_TRUE(page.count == 0 && page.next_cursor == LOBBY_SCAN_LIMIT);
+    args.lobby.cursor = page.next_cursor;
+    queryLobby(client_name, &args.lobby, &page);
+    TEST_ASSERT_TRUE(page.count == 0 && page.next_cursor == 0);
+
+    // A full room leaves the lobby, the binary page decodes to the same rooms
+    TEST_ASSERT_TRUE(joinGame(1, client_name));
+    TEST_ASSERT_TRUE(parseArguments(ARGS_LOBBY, (Span){"3,f,0", 5}, &args));
+    queryLobby("baz", &args.lobby, &page);
+    TEST_ASSERT_TRUE(membership.num_open == 1999 && page.rooms[0].game_id == 21);
+    uint8_t buffer[LOBBY_PAGE_MAX_SIZE];
+    size_t length = encodeLobbyPage(&page, buffer);
+    TEST_ASSERT_TRUE(decodeLobbyPage(buffer, length, &decoded));
+    TEST_ASSERT_TRUE(decoded.count == 3 && decoded.next_cursor == page.next_cursor && decoded.rooms[2].game_id == page.rooms[2].game_id);
+    TEST_ASSERT_FALSE(parseArguments(ARGS_LOBBY, (Span){"3,x,0", 5}, &args));
+    TEST_ASSERT_FALSE(parseArguments(ARGS_LOBBY, (Span){"3,a,0,2", 7}, &args));
+
+    // A page that fills up on the last room is the last page
+    resetGames();
+    for (int i = 0; i < LOBBY_SCREEN_ROWS; i++)
+    {
+        createNewGameServer(2, 3);
+    }
+    LobbyQuery screen = {LOBBY_SCREEN_ROWS, LOBBY_BY_AGE, 0, 0, 0, 0};
+    queryLobby(client_name, &screen, &page);
+    TEST_ASSERT_TRUE(page.count == LOBBY_SCREEN_ROWS && page.next_cursor == 0);
+    screen.count = LOBBY_SCREEN_ROWS - 1;
+    queryLobby(client_name, &screen, &page);
+    TEST_ASSERT_TRUE(page.count == LOBBY_SCREEN_ROWS - 1 && page.next_cursor != 0);
+    screen.cursor = page.next_cursor;
+    queryLobby(client_name, &screen, &page);
+    TEST_ASSERT_TRUE(page.count == 1 && page.next_cursor == 0);
+}
+
+// The leaderboard order: more points first, then by name
+int comparePlayers(const void *a, const void *b)
+{
+    const Player *first = a, *second = b;
+    if (first->score != second->score)
+    {
+        return second->score - first->score;
+    }
+    return strcmp(first->name, second->name);
+}
+
+void test_ranked_leaderboard(void)
+{
+    // Random points for a few hundred players, the ranking always matches the sorted leaderboard
+    char name[6];
+    for (int i = 0; i < 300; i++)
+    {
+        snprintf(name, sizeof(name), "r%d", i);
+        TEST_ASSERT_TRUE(registerClient(name));
+    }
+    srand(7);
+    for (int i = 0; i < 3000; i++)
+    {
+        addPlayerPoints(rand() % 300, rand() % 5);
+    }
+    Player sorted[300];
+    memcpy(sorted, players, sizeof(sorted));
+    qsort(sorted, 300, sizeof(Player), comparePlayers);
+    TEST_ASSERT_TRUE(rank_nodes[rank_root].size == 300);
+    for (int i = 0; i < 300; i++)
+    {
+        int player_id = rankedPlayer(i);
+        TEST_ASSERT_TRUE(strcmp(players[player_id].name, sorted[i].name) == 0);
+        TEST_ASSERT_TRUE(playerRank(player_id) == i);
+    }
+    TEST_ASSERT_TRUE(rankedPlayer(300) == -1);
+
+    // The top and the place of a player survive the binary encoding
+    LeaderBoardTop top, decoded;
+    getLeaderBoardTop(sorted[150].name, 3, &top);
+    TEST_ASSERT_TRUE(top.num_ranked == 300 && top.count == 3 && top.my_rank == 151);
+    uint8_t buffer[LEADERBOARD_TOP_MAX_SIZE];
+    size_t length = encodeLeaderBoardTop(&top, buffer);
+    TEST_ASSERT_TRUE(decodeLeaderBoardTop(buffer, length, &decoded));
+    TEST_ASSERT_TRUE(decoded.my_rank == 151 && decoded.me.score == sorted[150].score && decoded.count == 3);
+    TEST_ASSERT_TRUE(strcmp(decoded.top[0].name, sorted[0].name) == 0 && decoded.top[2].score == sorted[2].score);
+    TEST_ASSERT_FALSE(decodeLeaderBoardTop(buffer, length - 1, &decoded));
+
+    // A name that is not registered has no place
+    getLeaderBoardTop("nobody", MAX_LEADERBOARD_TOP, &top);
+    TEST_ASSERT_TRUE(top.my_rank == 0 && top.count == MAX_LEADERBOARD_TOP);
+
+    // Pages of the leaderboard, the last one is shorter and after it they are empty
+    LeaderBoardPage page, decoded_page;
+    getLeaderBoardPage(280, 30, &page);
+    TEST_ASSERT_TRUE(page.num_ranked == 300 && page.first_rank == 281 && page.count == 20);
+    TEST_ASSERT_TRUE(strcmp(page.players[0].name, sorted[280].name) == 0 && strcmp(page.players[19].name, sorted[299].name) == 0);
+    getLeaderBoardPage(300, 30, &page);
+    TEST_ASSERT_TRUE(page.count == 0 && page.first_rank == 0);
+    TEST_ASSERT_TRUE(leaderBoardCount() == 300);
+
+    // The players around a place, cut at the top of the leaderboard
+    getLeaderBoardAround(sorted[150].name, 5, &page);
+    TEST_ASSERT_TRUE(page.my_rank == 151 && page.first_rank == 146 && page.count == 11);
+    TEST_ASSERT_TRUE(strcmp(page.players[5].name, sorted[150].name) == 0);
+    getLeaderBoardAround(sorted[1].name, 5, &page);
+    TEST_ASSERT_TRUE(page.my_rank == 2 && page.first_rank == 1 && page.count == 7);
+    uint8_t page_buffer[LEADERBOARD_PAGE_MAX_SIZE];
+    length = encodeLeaderBoardPage(&page, page_buffer);
+    TEST_ASSERT_TRUE(decodeLeaderBoardPage(page_buffer, length, &decoded_page));
+    TEST_ASSERT_TRUE(decoded_page.my_rank == 2 && decoded_page.count == 7 && strcmp(decoded_page.players[6].name, sorted[6].name) == 0);
+    getLeaderBoardAround("nobody", 5, &page);
+    TEST_ASSERT_TRUE(page.my_rank == 0 && page.count == 0);
+}
+
+void test_round_points(void)
+{
+    // Two rocks, a paper and a scissors in one word, a player without a move is not counted
+    int count[4] = {0, 0, 0, 0};
+    countRoundMoves(packRoundMoves("rpsrn"), count);
+    TEST_ASSERT_TRUE(count[MOVE_NONE] == 0 && count[MOVE_ROCK] == 2 && count[MOVE_PAPER] == 1 && count[MOVE_SCISSORS] == 1);
+
+    // A game wider than one round word gives the same points as comparing every pair of players
+    Game game;
+    memset(&game, 0, sizeof(game));
+    TEST_ASSERT_TRUE(allocateGameRecord(&game, 300, 2));
+    for (int i = 0; i < 300; i++)
+    {
+        // Every move except a few missing ones
+        if (i % 7 != 3)
+        {
+            TEST_ASSERT_TRUE(submitMove(&game, 1, i, (MoveCode)(1 + (i * i) % 3)));
+        }
+    }
+    TEST_ASSERT_FALSE(submitMove(&game, 1, 299, MOVE_ROCK));
+    TEST_ASSERT_TRUE(game.round_moved[1] == 300 - 43 && game.round_moved[0] == 0);
+    scoreRound(&game, 1);
+    for (int i = 0; i < 300; i++)
+    {
+        int pair_points = 0;
+        for (int j = 0; j < 300; j++)
+        {
+            MoveCode mine = gameMove(&game, 1, i), theirs = gameMove(&game, 1, j);
+            pair_points += mine != MOVE_NONE && theirs != MOVE_NONE && (mine - theirs + 3) % 3 == 1 ? 1 : 0;
+        }
+        TEST_ASSERT_TRUE(game.playerScores[i] == pair_points);
+    }
+
+    // The wide game fits into the binary encoding
+    uint8_t buffer[GAME_INFO_MAX_SIZE];
+    GameInfoView view;
+    game.started = true;
+    game.current_round = 3;
+    size_t length = encodeGameInfo(&game, buffer);
+    TEST_ASSERT_TRUE(decodeGameInfo(buffer, length, &view));
+    TEST_ASSERT_TRUE(view.num_players == 300 && view.scores[299] == game.playerScores[299]);
+    TEST_ASSERT_TRUE(gameInfoMove(&view, 1, 3) == 'n' && gameInfoMove(&view, 1, 299) == moveChar(gameMove(&game, 1, 299)));
+    freeGameRecord(&game);
+}
+
+void submitTestRequest(Connection *connection, CommandCode command, const char *args, uint32_t correlation_id)
+{
+    Request request;
+    memset(&request, 0, sizeof(request));
+    strcpy(request.client_name, connection->name);
+    request.connection = connection;
+    request.command = command;
+    request.args = args;
+    request.args_length = strlen(args);
+    request.correlation_id = correlation_id;
+    submitRequest(&request);
+}
+
+void test_request_workers(void)
+{
+    char client_name[] = "foo";
+    registerClient(client_name);
+    createNewGameServer(2, 3);
+    int fds[2];
+    TEST_ASSERT_TRUE(pipe(fds) == 0);
+    Connection *connection = allocateConnection(fds[1], 0);
+    bindConnection(connection, client_name);
+    TEST_ASSERT_TRUE(startRequestWorkers(2));
+
+    // The requests of a client are answered in the order they were sent, US goes back to the loop and has no answer
+    submitTestRequest(connection, CMD_JOIN_GAME, "1", 1);
+    submitTestRequest(connection, CMD_GAME_INFO, "1", 2);
+    submitTestRequest(connection, CMD_UNSUBSCRIBE, "", 3);
+    submitTestRequest(connection, CMD_CURRENT_GAMES, "", 4);
+    while (atomic_load(&request_stage.handled) < 4)
+    {
+        usleep(100);
+    }
+    drainRequestOutboxes();
+    char buffer[BUFSIZ];
+    ssize_t length = read(fds[0], buffer, sizeof(buffer));
+    const char *expected[] = {"joined", "notstarted", "1,"};
+    uint32_t expected_ids[] = {1, 2, 4};
+    size_t offset = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        FrameHeader header;
+        const char *payload;
+        TEST_ASSERT_TRUE(decodeFrame(buffer + offset, (size_t)length - offset, &header, &payload));
+        TEST_ASSERT_TRUE(header.correlation_id == expected_ids[i]);
+        TEST_ASSERT_TRUE(header.length == strlen(expected[i]) && strncmp(payload, expected[i], header.length) == 0);
+        offset += sizeof(FrameHeader) + header.length;
+    }
+    TEST_ASSERT_TRUE(offset == (size_t)length);
+
+    // The answer to a client that disconnected in the meantime is dropped
+    submitTestRequest(connection, CMD_GAME_INFO, "1", 5);
+    while (atomic_load(&request_stage.handled) < 5)
+    {
+        usleep(100);
+    }
+    closeConnection(connection);
+    stopRequestWorkers();
+    TEST_ASSERT_TRUE(read(fds[0], buffer, sizeof(buffer)) == 0);
+    close(fds[0]);
+}
+
 int main(void)
 {
     UNITY_BEGIN();
@@ -327,6 +1140,27 @@ int main(void)
     RUN_TEST(test_multiple_games_same_time);
     RUN_TEST(test_waiting_rooms);
     RUN_TEST(test_games);
+    RUN_TEST(test_shm_request_ring);
+    RUN_TEST(test_shm_response_ring);
+    RUN_TEST(test_frame_reader);
+    RUN_TEST(test_binary_game_info);
+    RUN_TEST(test_binary_lists);
+    RUN_TEST(test_game_subscription);
+    RUN_TEST(test_game_delta);
+    RUN_TEST(test_command_arguments);
+    RUN_TEST(test_game_workers);
+    RUN_TEST(test_game_locks);
+    RUN_TEST(test_move_submission);
+    RUN_TEST(test_game_slots);
+    RUN_TEST(test_game_arena);
+    RUN_TEST(test_timer_wheel);
+    RUN_TEST(test_game_deadlines);
+    RUN_TEST(test_player_registry);
+    RUN_TEST(test_ranked_leaderboard);
+    RUN_TEST(test_game_membership);
+    RUN_TEST(test_lobby_query);
+    RUN_TEST(test_round_points);
+    RUN_TEST(test_request_workers);
 
     UNITY_END();
 